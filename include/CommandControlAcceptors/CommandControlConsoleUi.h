@@ -5,6 +5,8 @@
 #include <map>
 #include <tuple>
 #include <chrono>
+#include <sstream>
+#include <iomanip>
 
 #include <nlohmann/json.hpp>
 
@@ -12,6 +14,7 @@
 #include "ICommandControlAcceptor.h"
 #include "IModelHelper.h"
 #include "KeyListener.h"
+#include "ConsoleFrameBuffer.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
@@ -34,7 +37,8 @@ namespace embeddedpenguins::core::neuron::model
 
         unsigned int windowWidth_ = 15;
         unsigned int windowHeight_ = 15;
-        string cls {"\033[2J\033[H"};
+        ConsoleFrameBuffer frame_ { };
+        std::ostringstream lineStream_ { };
 
         map<string, tuple<int, int>> namedNeurons_ { };
 
@@ -188,38 +192,51 @@ namespace embeddedpenguins::core::neuron::model
         virtual const string& Legend() = 0;
         virtual char EmitToken(unsigned long neuronIndex) = 0;
 
+        //
+        // Append the tokens for a row of count neurons starting at neuronIndex.
+        // Views that can fetch and map a row at once should override this.
+        //
+        virtual void EmitTokens(unsigned long neuronIndex, unsigned int count, string& line)
+        {
+            for (auto offset = 0U; offset < count; offset++)
+                line += EmitToken(neuronIndex + offset);
+        }
+
     private:
+        //
+        // Compose the visible window of the network into the frame buffer,
+        // and present only what changed since the last frame.
+        //
         void PrintNetworkScan()
         {
-            cout << cls;
+            frame_.BeginFrame();
 
             auto neuronIndex = ((width_ * (centerHeight_ - (windowHeight_ / 2))) + centerWidth_ - (windowWidth_ / 2));
             for (auto high = windowHeight_; high; --high)
             {
-                for (auto wide = windowWidth_; wide; --wide)
-                {
-                    cout << EmitToken(neuronIndex);
-                    neuronIndex++;
-                }
-                cout << '\n';
+                EmitTokens(neuronIndex, windowWidth_, frame_.NextLine());
 
-                neuronIndex += width_ - windowWidth_;
+                neuronIndex += width_;
                 if (neuronIndex > modelRunner_.ModelSize()) neuronIndex = 0;
             }
 
-            cout
+            ResetLineStream();
+            lineStream_
                 <<  Legend() << ":(" << centerWidth_ << "," << centerHeight_ << ") "
                 << " Tick: " << modelRunner_.EnginePeriod().count() << " us "
                 << "Iterations: " << modelRunner_.GetIterations() 
                 << "  Total work: " << modelRunner_.GetTotalWork() 
-                << "                 \n";
+                << "                 ";
+            frame_.NextLine() = lineStream_.str();
+
+            frame_.NextLine() = "Arrow keys to navigate       + and - keys control speed            q to quit";
 
-            cout << "Arrow keys to navigate       + and - keys control speed            q to quit\n";
+            frame_.Present();
         }
 
         void PrintMonitoredNeurons()
         {
-            cout << cls;
+            frame_.BeginFrame();
 
             for (auto& [neuronName, posTuple] : namedNeurons_)
             {
@@ -227,33 +244,46 @@ namespace embeddedpenguins::core::neuron::model
                 auto neuronIndex = helper_->GetIndex(ypos, xpos);
                 auto neuronActivation = helper_->GetNeuronActivation(neuronIndex);
                 auto neuronTicksSinceLastSpike = helper_->GetNeuronTicksSinceLastSpike(neuronIndex);
-                cout << "Neuron " << std::setw(15) << neuronName << " [" << ypos << ", " << xpos << "] = " << std::setw(4) << neuronIndex << ": ";
-                cout << std::setw(5) << neuronActivation << "(" << std::setw(3) << neuronTicksSinceLastSpike << ")";
-                cout << std::endl;
 
+                ResetLineStream();
+                lineStream_ << "Neuron " << std::setw(15) << neuronName << " [" << ypos << ", " << xpos << "] = " << std::setw(4) << neuronIndex << ": ";
+                lineStream_ << std::setw(5) << neuronActivation << "(" << std::setw(3) << neuronTicksSinceLastSpike << ")";
+                frame_.NextLine() = lineStream_.str();
+
+                ResetLineStream();
                 for (auto synapseId = 0; synapseId < SynapticConnectionsPerNode; synapseId++)
                 {
                     if (helper_->IsSynapseUsed(neuronIndex, synapseId))
                     {
                         auto presynapticNeuronIndex = helper_->GetPresynapticNeuron(neuronIndex, synapseId);
-                        cout << std::setw(20) << presynapticNeuronIndex
+                        lineStream_ << std::setw(20) << presynapticNeuronIndex
                         << "(" << std::setw(3) << helper_->GetSynapticStrength(neuronIndex, synapseId) << ")  ";
                     }
                 }
+                frame_.NextLine() = lineStream_.str();
 
-                cout << std::endl;
-                cout << std::endl;
+                frame_.NextLine();
             }
-            cout << std::endl;
+            frame_.NextLine();
 
-            cout
+            ResetLineStream();
+            lineStream_
                 <<  Legend() << ": "
                 << " Tick: " << modelRunner_.EnginePeriod().count() << " us "
                 << "Iterations: " << modelRunner_.GetIterations() 
                 << "  Total work: " << modelRunner_.GetTotalWork() 
-                << "                 \n";
+                << "                 ";
+            frame_.NextLine() = lineStream_.str();
+
+            frame_.NextLine() = "+ and - keys control speed            q to quit";
 
-            cout << "+ and - keys control speed            q to quit\n";
+            frame_.Present();
+        }
+
+        void ResetLineStream()
+        {
+            lineStream_.str("");
+            lineStream_.clear();
         }
     };
 }
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+
+#include <unistd.h>
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::vector;
+
+    //
+    // A text frame for a full-screen console view.  The view writes each
+    // line of the frame into a reusable buffer; Present() then compares the
+    // frame with the previous one and writes only the changed cells,
+    // positioned with ANSI cursor moves, in a single write to the terminal.
+    // An unchanged frame costs no output at all.
+    //
+    // Other output to the terminal (logging) would leave stale cells
+    // behind, so the whole frame is redrawn every fullRedrawFrames frames,
+    // or on the next frame after Invalidate().
+    //
+    class ConsoleFrameBuffer
+    {
+        vector<string> lines_ { };
+        vector<string> previousLines_ { };
+        unsigned int lineCount_ { 0 };
+        string output_ { };
+
+        unsigned int fullRedrawFrames_;
+        unsigned int framesSinceRedraw_ { 0 };
+        bool invalid_ { true };
+
+    public:
+        ConsoleFrameBuffer(unsigned int fullRedrawFrames = 20) :
+            fullRedrawFrames_(fullRedrawFrames)
+        {
+        }
+
+        //
+        // Start composing a new frame.
+        //
+        void BeginFrame()
+        {
+            lineCount_ = 0;
+        }
+
+        //
+        // Return the next line of the frame, cleared, to be filled in.
+        //
+        string& NextLine()
+        {
+            if (lineCount_ == lines_.size())
+                lines_.emplace_back();
+
+            auto& line = lines_[lineCount_++];
+            line.clear();
+            return line;
+        }
+
+        //
+        // Force a full redraw on the next frame.
+        //
+        void Invalidate()
+        {
+            invalid_ = true;
+        }
+
+        //
+        // Write the differences between this frame and the previous one to the terminal.
+        //
+        void Present()
+        {
+            output_.clear();
+
+            if (invalid_ || ++framesSinceRedraw_ >= fullRedrawFrames_)
+                ComposeFullFrame();
+            else
+                ComposeChangedCells();
+
+            if (previousLines_.size() < lineCount_)
+                previousLines_.resize(lineCount_);
+            for (unsigned int row = 0; row < lineCount_; row++)
+                previousLines_[row].assign(lines_[row]);
+            previousLines_.resize(lineCount_);
+
+            if (output_.empty()) return;
+
+            // Anything already buffered in cout belongs before this frame.
+            cout.flush();
+            Write(output_);
+        }
+
+    private:
+        void ComposeFullFrame()
+        {
+            output_ += "\033[2J\033[H";
+            for (unsigned int row = 0; row < lineCount_; row++)
+            {
+                output_ += lines_[row];
+                output_ += '\n';
+            }
+
+            invalid_ = false;
+            framesSinceRedraw_ = 0;
+        }
+
+        void ComposeChangedCells()
+        {
+            const string empty { };
+            for (unsigned int row = 0; row < lineCount_; row++)
+            {
+                auto& line = lines_[row];
+                auto& previous = row < previousLines_.size() ? previousLines_[row] : empty;
+                if (line == previous) continue;
+
+                // Rewrite from the first to the last changed column.
+                size_t first { 0 };
+                while (first < line.size() && first < previous.size() && line[first] == previous[first])
+                    first++;
+
+                size_t last = line.size();
+                if (line.size() == previous.size())
+                    while (last > first && line[last - 1] == previous[last - 1])
+                        last--;
+
+                MoveCursor(row, first);
+                output_.append(line, first, last - first);
+                if (line.size() < previous.size())
+                    output_ += "\033[K";
+            }
+
+            // Lines beyond the end of a shorter frame.
+            for (unsigned int row = lineCount_; row < previousLines_.size(); row++)
+            {
+                MoveCursor(row, 0);
+                output_ += "\033[K";
+            }
+
+            if (!output_.empty())
+                MoveCursor(lineCount_, 0);
+        }
+
+        void MoveCursor(unsigned int row, size_t column)
+        {
+            output_ += "\033[";
+            output_ += std::to_string(row + 1);
+            output_ += ';';
+            output_ += std::to_string(column + 1);
+            output_ += 'H';
+        }
+
+        static void Write(const string& output)
+        {
+            const char* buffer = output.data();
+            auto length = output.size();
+            while (length > 0)
+            {
+                auto written = write(STDOUT_FILENO, buffer, length);
+                if (written < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return;
+                }
+
+                buffer += written;
+                length -= written;
+            }
+        }
+    };
+}
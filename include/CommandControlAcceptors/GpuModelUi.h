@@ -1,6 +1,10 @@
 #pragma once
 
+#include <vector>
+#include <algorithm>
+
 #include "CommandControlConsoleUi.h"
+#include "IntensityMap.h"
 
 #include "ModelRunner.h"
 #include "GpuModelHelper.h"
@@ -8,12 +12,17 @@
 
 namespace embeddedpenguins::gpu::neuron::model
 {
+    using std::vector;
+
     using embeddedpenguins::core::neuron::model::IModelRunner;
     using embeddedpenguins::core::neuron::model::CommandControlConsoleUi;
+    using embeddedpenguins::core::neuron::model::IntensityMap;
 
     class GpuModelUi : public CommandControlConsoleUi
     {
         string legend_ {};
+        IntensityMap intensityMap_ { {2,5,15,50}, " .*oO" };
+        vector<short int> activations_ {};
 
     public:
         GpuModelUi(IModelRunner& modelRunner) :
@@ -27,24 +36,28 @@ namespace embeddedpenguins::gpu::neuron::model
             if (neuronIndex >= modelRunner_.ModelSize()) return '=';
             
             auto activation = helper_->GetNeuronActivation(neuronIndex);
-            return MapIntensity(activation);
+            return intensityMap_.Map(activation);
         }
 
-        virtual const string& Legend() override
+        //
+        // Fetch the whole row of activations at once, and map them together.
+        //
+        virtual void EmitTokens(unsigned long neuronIndex, unsigned int count, string& line) override
         {
-            return legend_;
+            auto modelSize = modelRunner_.ModelSize();
+            unsigned int inModel = neuronIndex >= modelSize ? 0 : std::min<unsigned long>(count, modelSize - neuronIndex);
+
+            activations_.resize(inModel);
+            helper_->CopyActivations(neuronIndex, inModel, activations_.data());
+
+            auto start = line.size();
+            line.resize(start + count, '=');
+            intensityMap_.Map(activations_.data(), inModel, line.data() + start);
         }
 
-    private:
-        char MapIntensity(int activation)
+        virtual const string& Legend() override
         {
-            static int cutoffs[] = {2,5,15,50};
-
-            if (activation < cutoffs[0]) return ' ';
-            if (activation < cutoffs[1]) return '.';
-            if (activation < cutoffs[2]) return '*';
-            if (activation < cutoffs[3]) return 'o';
-            return 'O';
+            return legend_;
         }
     };
 }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace embeddedpenguins::core::neuron::model
+{
+    //
+    // Map activations to display glyphs by a table of ascending cutoffs:
+    // an activation below cutoff 0 maps to glyph 0, one at or above
+    // cutoff k (but below cutoff k+1) maps to glyph k+1.
+    // Where SSE2 is available, sixteen activations are mapped at a time
+    // with a branch-free compare and blend against the cutoff table;
+    // otherwise, and for the tail of a row, a scalar loop does the same.
+    //
+    class IntensityMap
+    {
+    public:
+        static constexpr unsigned int CutoffCount { 4 };
+
+    private:
+        short int cutoffs_[CutoffCount];
+        char glyphs_[CutoffCount + 1];
+
+    public:
+        IntensityMap(const short int (&cutoffs)[CutoffCount], const char (&glyphs)[CutoffCount + 2])
+        {
+            for (unsigned int level = 0; level < CutoffCount; level++)
+                cutoffs_[level] = cutoffs[level];
+            for (unsigned int level = 0; level <= CutoffCount; level++)
+                glyphs_[level] = glyphs[level];
+        }
+
+        char Map(short int activation) const
+        {
+            unsigned int level { 0 };
+            while (level < CutoffCount && activation >= cutoffs_[level])
+                level++;
+
+            return glyphs_[level];
+        }
+
+        void Map(const short int* activations, size_t count, char* glyphs) const
+        {
+            size_t index { 0 };
+
+#if defined(__SSE2__)
+            // glyph = glyph[0] + sum over k of (activation >= cutoff[k] ? glyph[k+1] - glyph[k] : 0)
+            __m128i cutoffs[CutoffCount];
+            __m128i deltas[CutoffCount];
+            for (unsigned int level = 0; level < CutoffCount; level++)
+            {
+                cutoffs[level] = _mm_set1_epi16(cutoffs_[level]);
+                deltas[level] = _mm_set1_epi8(static_cast<char>(glyphs_[level + 1] - glyphs_[level]));
+            }
+            const __m128i base = _mm_set1_epi8(glyphs_[0]);
+
+            for (; index + 16 <= count; index += 16)
+            {
+                auto low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(activations + index));
+                auto high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(activations + index + 8));
+
+                auto result = base;
+                for (unsigned int level = 0; level < CutoffCount; level++)
+                {
+                    // Masks are 0 or -1 per lane, and stay so when packed to bytes.
+                    // Below the cutoff is masked out, so any cutoff, even SHRT_MIN, compares exactly.
+                    auto below = _mm_packs_epi16(_mm_cmplt_epi16(low, cutoffs[level]), _mm_cmplt_epi16(high, cutoffs[level]));
+                    result = _mm_add_epi8(result, _mm_andnot_si128(below, deltas[level]));
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(glyphs + index), result);
+            }
+#endif
+
+            for (; index < count; index++)
+                glyphs[index] = Map(activations[index]);
+        }
+    };
+}
@@ -4,23 +4,22 @@
 #include <memory>
 #include <map>
 #include <string>
+#include <vector>
 #include <utility>
 #include <functional>
 
-#include "libsocket/exception.hpp"
-#include "libsocket/inetserverstream.hpp"
-#include "libsocket/select.hpp"
-#include "libsocket/socket.hpp"
-
+#include <poll.h>
 
 #include "ICommandControlAcceptor.h"
 #include "QueryResponseSocket.h"
 #include "IQueryHandler.h"
+#include "StreamTransport.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::map;
+    using std::vector;
     using std::string;
     using std::unique_ptr;
     using std::make_unique;
@@ -28,24 +27,24 @@ namespace embeddedpenguins::core::neuron::model
     using std::end;
     using std::function;
 
-    using libsocket::socket;
-    using libsocket::inet_stream;
-    using libsocket::inet_stream_server;
-    using libsocket::selectset;
-
+    //
+    // Listen for command and control clients.  The host and port come from
+    // the stack configuration service, so either may name a Unix domain or
+    // abstract socket ('unix:/path', '@name') for clients on this host.
+    //
     class QueryResponseListenSocket : public ICommandControlAcceptor
     {
-        inet_stream_server server_;
-        unique_ptr<selectset<socket>> selectSet_ { };
+        StreamListener server_ { };
+        vector<pollfd> pollFds_ { };
 
-        map<socket*, unique_ptr<QueryResponseSocket>> ccSockets_ { };
+        map<int, unique_ptr<QueryResponseSocket>> ccSockets_ { };
 
     public:
-        QueryResponseListenSocket(const string& host, const string& port) :
-            server_(host, port, LIBSOCKET_IPv4)
+        QueryResponseListenSocket(const string& host, const string& port)
         {
-            // Louis Ross - I modified libsocket to always apply SO_REUSEADDR=1 just before a server socket binds.
-            cout << "QueryResponseListenSocket with fd=" << server_.getfd() << " listening at " << host << ":" << port << "\n";
+            auto endpoint = StreamEndpoint::FromHostPort(host, port);
+            if (server_.Listen(endpoint))
+                cout << "QueryResponseListenSocket with fd=" << server_.Fd() << " listening at " << endpoint.ToString() << "\n";
         }
 
         QueryResponseListenSocket(const QueryResponseListenSocket& other) = delete;
@@ -56,7 +55,7 @@ namespace embeddedpenguins::core::neuron::model
         virtual ~QueryResponseListenSocket()
         {
             cout << "QueryResponseListenSocket dtor\n";
-            server_.destroy();
+            server_.Close();
         }
 
         virtual const string& Description() override
@@ -73,82 +72,115 @@ namespace embeddedpenguins::core::neuron::model
 
         virtual bool Initialize() override
         {
-            MakeSelectSet();
-            return true;
+            MakePollSet();
+            return server_.Listening();
         }
 
         //
         // The main action handler.  Call periodically from the main loop.
-        // Wait a few milliseconds for one of the sockets in the select set
-        // to be readable, then handle all that are.
-        // Use dynamic_cast to distinguish between socket types.
+        // Wait a few milliseconds for one of the sockets in the poll set
+        // to be readable, or writable if it has a response still unsent,
+        // then handle all that are.
+        // The listen socket is always first in the set.
         //
         virtual bool AcceptAndExecute(unique_ptr<IQueryHandler> const & queryHandler) override
         {
-            auto [readSockets, _] = selectSet_->wait(10'000);
-
-            for (auto readSocket : readSockets)
+            for (auto& pollFd : pollFds_)
             {
-                inet_stream_server* listenSocket = dynamic_cast<inet_stream_server*>(readSocket);
-                if (listenSocket != nullptr)
-                    AcceptNewConnection(readSocket, listenSocket);
-
-                inet_stream* dataSocket = dynamic_cast<inet_stream*>(readSocket);
-                if (dataSocket != nullptr)
-                    HandleInput(readSocket, dataSocket, queryHandler);
+                auto iSocket = ccSockets_.find(pollFd.fd);
+                if (iSocket != end(ccSockets_))
+                    pollFd.events = iSocket->second->HasUnsent() ? (POLLIN | POLLOUT) : POLLIN;
             }
 
-            for (auto& [readSocket, responseSocket] : ccSockets_)
+            if (poll(pollFds_.data(), pollFds_.size(), 10) > 0)
             {
-                inet_stream* dataSocket = dynamic_cast<inet_stream*>(readSocket);
-                if (dataSocket != nullptr)
-                    responseSocket->DoPeriodicSupport(queryHandler);
+                // Handling may change the set, so work from the ready descriptors alone.
+                vector<int> readFds { };
+                vector<int> writeFds { };
+                for (auto& pollFd : pollFds_)
+                {
+                    if (pollFd.revents & (POLLIN | POLLHUP | POLLERR))
+                        readFds.push_back(pollFd.fd);
+                    else if (pollFd.revents & POLLOUT)
+                        writeFds.push_back(pollFd.fd);
+                }
+
+                for (auto fd : writeFds)
+                    ContinueSending(fd);
+
+                for (auto fd : readFds)
+                {
+                    if (fd == server_.Fd())
+                        AcceptNewConnection();
+                    else
+                        HandleInput(fd, queryHandler);
+                }
             }
 
+            // Status is rendered at most once per pass, however many clients are due.
+            SharedStatus status(*queryHandler);
+            vector<int> failedFds { };
+            for (auto& [fd, responseSocket] : ccSockets_)
+                if (!responseSocket->DoPeriodicSupport(status))
+                    failedFds.push_back(fd);
+
+            for (auto fd : failedFds)
+                CloseConnection(fd);
+
             return false;
         }
 
     private:
-        void AcceptNewConnection(socket* readSocket, inet_stream_server* listenSocket)
+        void AcceptNewConnection()
         {
-            if (ccSockets_.find(readSocket) == end(ccSockets_))
-            {
-                cout << "QueryResponseListenSocket found readable socket is listen socket, creating new connection\n";
-                auto dataSocket = make_unique<QueryResponseSocket>(listenSocket);
-                ccSockets_[dataSocket->StreamSocket()] = std::move(dataSocket);
-                MakeSelectSet();
-            }
+            cout << "QueryResponseListenSocket found readable socket is listen socket, creating new connection\n";
+            auto dataSocket = make_unique<QueryResponseSocket>(&server_);
+            if (!dataSocket->StreamSocket()) return;
+
+            auto fd = dataSocket->StreamSocket()->Fd();
+            ccSockets_[fd] = std::move(dataSocket);
+            MakePollSet();
         }
 
-        void HandleInput(socket* readSocket, inet_stream* dataSocket, unique_ptr<IQueryHandler> const & queryHandler)
+        void HandleInput(int fd, unique_ptr<IQueryHandler> const & queryHandler)
         {
             cout << "QueryResponseListenSocket found readable data socket, handling request\n";
-            auto iSocket = ccSockets_.find(readSocket);
+            auto iSocket = ccSockets_.find(fd);
             if (iSocket != end(ccSockets_))
             {
                 if (!iSocket->second->HandleInput(queryHandler))
                 {
-                    cout << "QueryResponseListenSocket: readable data socket closed by client\n";
-                    ccSockets_.erase(iSocket);
-                    MakeSelectSet();
+                    cout << "QueryResponseListenSocket: readable data socket closed\n";
+                    CloseConnection(fd);
                 }
             }
         }
 
+        void ContinueSending(int fd)
+        {
+            auto iSocket = ccSockets_.find(fd);
+            if (iSocket != end(ccSockets_) && !iSocket->second->ContinueSending())
+                CloseConnection(fd);
+        }
+
+        void CloseConnection(int fd)
+        {
+            if (ccSockets_.erase(fd) > 0)
+                MakePollSet();
+        }
+
         //
-        // Throw away the existing select set (if any) and create a new one
-        // with read function for the listen server socket and the streaming
-        // sockets of all current data sockets.
+        // Rebuild the poll set from the listen server socket and the
+        // streaming sockets of all current data sockets.
         //
-        void MakeSelectSet()
+        void MakePollSet()
         {
-            selectSet_.reset(new selectset<socket>());
+            pollFds_.clear();
 
-            selectSet_->add_fd(server_, LIBSOCKET_READ);
-            for (auto iSocket = begin(ccSockets_); iSocket != end(ccSockets_); iSocket++)
-            {
-                selectSet_->add_fd(*iSocket->second->StreamSocket(), LIBSOCKET_READ);
-            }
+            if (server_.Listening())
+                pollFds_.push_back(pollfd { server_.Fd(), POLLIN, 0 });
+            for (auto& [fd, responseSocket] : ccSockets_)
+                pollFds_.push_back(pollfd { fd, POLLIN, 0 });
         }
     };
 }
@@ -2,49 +2,155 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <memory>
 #include <functional>
 #include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <cctype>
 
-#include "libsocket/exception.hpp"
-#include "libsocket/inetserverstream.hpp"
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "nlohmann/json.hpp"
 
 #include "IQueryHandler.h"
+#include "StreamTransport.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::string;
+    using std::vector;
     using std::unique_ptr;
     using std::function;
     using std::chrono::milliseconds;
     using std::chrono::duration_cast;
     using namespace std::chrono_literals;
 
-    using libsocket::inet_stream;
-    using libsocket::inet_stream_server;
+    using nlohmann::json;
+
+    constexpr size_t LegacyMaximumMessageLength { 65'535 };
+    constexpr size_t MaximumMessageLength { 64 * 1024 * 1024 };
+    constexpr size_t ReceiveChunkLength { 4'096 };
+    constexpr nanoseconds SendStallTimeout { nanoseconds(5s) };
+    constexpr nanoseconds LegacyStatusPeriod { nanoseconds(250ms) };
+    constexpr nanoseconds MinimumSubscriptionPeriod { nanoseconds(10ms) };
+
+    //
+    // The model status, rendered at most once per pass of the listen socket
+    // and shared by every connection that needs it during that pass.
+    //
+    class SharedStatus
+    {
+        IQueryHandler& queryHandler_;
+        bool statusRendered_ { false };
+        json status_ { };
+        string fullStatusResponse_ { };
+
+    public:
+        SharedStatus(IQueryHandler& queryHandler) :
+            queryHandler_(queryHandler)
+        {
+        }
+
+        const json& Status()
+        {
+            if (!statusRendered_)
+            {
+                status_ = queryHandler_.RenderStatus();
+                statusRendered_ = true;
+            }
+
+            return status_;
+        }
+
+        //
+        // The same response a client would receive for a fullstatus query.
+        //
+        const string& FullStatusResponse()
+        {
+            if (fullStatusResponse_.empty())
+            {
+                json response;
+                response["query"] = { {"query", "fullstatus"} };
+                response["response"] = { {"status", Status()}, {"result", "ok"} };
+                fullStatusResponse_ = response.dump();
+            }
+
+            return fullStatusResponse_;
+        }
+    };
 
+    //
+    // One command and control client connection.
+    // Queries are either legacy bare JSON objects, or framed with a 32-bit
+    // big-endian length.  Responses to a legacy client carry a 16-bit
+    // native-order length; once a client sends a framed query, every
+    // response and push to it carries a 32-bit big-endian length instead.
+    //
+    // By default, the client is sent the full status as JSON every 250 ms.
+    // A client may instead subscribe to a set of status fields:
+    //
+    //  {"query": "subscribe", "fields": ["run", "iterations"], "period": 100}
+    //
+    // after which, at most once per period (in milliseconds), it is sent only
+    // the subscribed fields that changed since the last push, encoded as a
+    // CBOR map.  Nothing is sent while nothing changes.  An empty or missing
+    // field list subscribes to every status field.  A CBOR map never starts
+    // with '{', so clients can tell pushes from JSON responses by the first byte.
+    // {"query": "unsubscribe"} returns to full status polling.
+    //
+    // The socket never blocks.  Whatever a response does not fit in the
+    // socket is kept and finished when it becomes writable, and no status is
+    // pushed while any remains.  A client that takes nothing for
+    // SendStallTimeout, or sends a malformed frame, is disconnected.
+    //
     class QueryResponseSocket
     {
-        unique_ptr<inet_stream> streamSocket_;
+        unique_ptr<StreamConnection> streamSocket_;
 
         string query_ { };
         embeddedpenguins::core::neuron::model::time_point startTime_ {};
         bool firstPeriodicSupport { true };
 
+        bool framed_ { false };
+        vector<char> receiveBuffer_ { };
+        size_t receiveLength_ { 0 };
+        vector<char> unsent_ { };
+        size_t unsentOffset_ { 0 };
+        embeddedpenguins::core::neuron::model::time_point lastSendProgress_ {};
+        bool failed_ { false };
+
+        bool subscribed_ { false };
+        vector<string> subscribedFields_ { };
+        nanoseconds subscriptionPeriod_ { LegacyStatusPeriod };
+        json lastPushed_ { json::object() };
+
 
     public:
-        inet_stream* StreamSocket() const { return streamSocket_.get(); }
+        StreamConnection* StreamSocket() const { return streamSocket_.get(); }
+        bool HasUnsent() const { return unsentOffset_ < unsent_.size(); }
 
     public:
-        QueryResponseSocket(inet_stream_server* ccSocket) :
-            streamSocket_(ccSocket->accept2())
+        //
+        // Accept the pending connection on the listener.  If that fails, StreamSocket() is null.
+        //
+        QueryResponseSocket(StreamListener* listener) :
+            streamSocket_(listener->Accept())
         {
-            // An attempt to stop the re-use timer at the system level, so we can restart immediately.
-            int reuseaddr = 1;
-            streamSocket_->set_sock_opt(streamSocket_->getfd(), SO_REUSEADDR, (const char*)(&reuseaddr), sizeof(int));
+            if (!streamSocket_) return;
 
-            cout << "QueryResponseSocket main ctor with host " << streamSocket_->gethost() << " and port " << streamSocket_->getport() << "\n";
+            cout << "QueryResponseSocket main ctor with peer " << streamSocket_->Peer() << "\n";
+            if (!streamSocket_->SetNonBlocking())
+            {
+                cout << "QueryResponseSocket unable to make connection non-blocking: " << std::strerror(errno) << "\n";
+                streamSocket_.reset();
+            }
         }
 
         QueryResponseSocket(const QueryResponseSocket& other) = delete;
@@ -55,114 +161,394 @@ namespace embeddedpenguins::core::neuron::model
         virtual ~QueryResponseSocket()
         {
             cout << "QueryResponseSocket dtor \n";
-            try
-            {
-                streamSocket_->shutdown(LIBSOCKET_READ | LIBSOCKET_WRITE);
-            }
-            catch (const libsocket::socket_exception& e)
-            {
-                // Swallow this exception:  If the client closed first, this operation will be
-                // incomplete, but if we are shutting down first, we need to do it.
-            }
+
+            // If the client closed first, this will fail harmlessly,
+            // but if we are shutting down first, we need to do it.
+            if (streamSocket_) streamSocket_->Shutdown();
         }
 
         //
         // The main operation.  If this socket becomes readable, call this method.
-        // We read the query from the command and control client and process it.
+        // We read whatever has arrived from the command and control client,
+        // and process every complete query; a partial query waits for more.
         // If the read is empty, assume the socket was closed by the client.
-        // Return true unless the client closed the socket and we need to clean up this end.
+        // Return true unless the client closed the socket, or the connection
+        // failed, and we need to clean up this end.
         //
         bool HandleInput(unique_ptr<IQueryHandler> const & queryHandler)
         {
-            try
-            {
-                string queryFragment;
-                queryFragment.resize(1000);
-                *streamSocket_ >> queryFragment;
+            auto open = ReceiveAvailable();
 
-                if (queryFragment.empty()) return false;
-
-                BuildInputString(queryFragment);
+            while (!failed_ && ExtractQuery())
+            {
                 startTime_ = high_resolution_clock::now();
 
                 cout << "Query: " << query_ << "\n";
 
-                string response = queryHandler->HandleQuery(query_);
+                string response;
+                if (!HandleSubscription(response))
+                    response = queryHandler->HandleQuery(query_);
                 BuildAndSendResponse(response);
+            }
 
-                //*streamSocket_ << response;
+            return open && !failed_;
+        }
 
-                return true;
-            }
-            catch(const libsocket::socket_exception& e)
-            {
-                return false;
-            }
+        //
+        // The socket is writable:  continue sending what did not fit before.
+        // Return false if the connection failed.
+        //
+        bool ContinueSending()
+        {
+            SendUnsent();
+            return !failed_;
         }
 
-        void DoPeriodicSupport(unique_ptr<IQueryHandler> const & queryHandler)
+        //
+        // Push status if due.  Return false if the connection failed.
+        //
+        bool DoPeriodicSupport(SharedStatus& status)
         {
             if (firstPeriodicSupport)
             {
                 startTime_ = high_resolution_clock::now();
                 firstPeriodicSupport = false;
-                return;
+                return true;
             }
 
-            const nanoseconds period = nanoseconds(250ms);
+            // A client still taking the last response gets no new status until it has.
+            if (HasUnsent())
+            {
+                SendUnsent();
+                return !failed_;
+            }
+
+            const nanoseconds period = subscribed_ ? subscriptionPeriod_ : LegacyStatusPeriod;
 
             embeddedpenguins::core::neuron::model::time_point currentTime = high_resolution_clock::now();
             if (currentTime - startTime_ > period)
             {
                 startTime_ += period;
+                if (currentTime - startTime_ > period)
+                    startTime_ = currentTime;
 
-                json query;
-                query["query"] = "fullstatus";
-                string response = "  " + queryHandler->HandleQuery(query.dump());
-                BuildAndSendResponse(response);
+                if (subscribed_)
+                {
+                    PushChangedFields(status.Status());
+                }
+                else if (framed_)
+                {
+                    BuildAndSendResponse(status.FullStatusResponse());
+                }
+                else
+                {
+                    BuildAndSendResponse("  " + status.FullStatusResponse());
+                }
             }
+
+            return !failed_;
         }
 
     private:
-        void BuildAndSendResponse(string& response)
+        //
+        // Subscription state belongs to this connection, so subscribe and
+        // unsubscribe queries are handled here rather than by the query handler.
+        // Return false if the query is not one of these.
+        //
+        bool HandleSubscription(string& response)
+        {
+            if (query_.find("subscribe") == string::npos) return false;
+
+            auto jsonQuery = json::parse(query_, nullptr, false);
+            if (jsonQuery.is_discarded() || !jsonQuery.contains("query") || !jsonQuery["query"].is_string())
+                return false;
+
+            auto query = jsonQuery["query"].get<string>();
+            if (query != "subscribe" && query != "unsubscribe")
+                return false;
+
+            json responseResponse;
+            if (query == "subscribe")
+            {
+                subscribedFields_.clear();
+                if (jsonQuery.contains("fields") && jsonQuery["fields"].is_array())
+                    for (auto& field : jsonQuery["fields"])
+                        if (field.is_string()) subscribedFields_.push_back(field.get<string>());
+
+                subscriptionPeriod_ = LegacyStatusPeriod;
+                if (jsonQuery.contains("period") && jsonQuery["period"].is_number())
+                    subscriptionPeriod_ = std::max(MinimumSubscriptionPeriod, nanoseconds(milliseconds(jsonQuery["period"].get<long long int>())));
+
+                subscribed_ = true;
+                responseResponse["fields"] = subscribedFields_;
+                responseResponse["period"] = duration_cast<milliseconds>(subscriptionPeriod_).count();
+            }
+            else
+            {
+                subscribed_ = false;
+            }
+
+            // Push everything subscribed on the next period.
+            lastPushed_ = json::object();
+            responseResponse["result"] = "ok";
+
+            json jsonResponse;
+            jsonResponse["query"] = jsonQuery;
+            jsonResponse["response"] = responseResponse;
+            response = jsonResponse.dump();
+
+            return true;
+        }
+
+        //
+        // Send the subscribed fields whose values differ from the last push, if any.
+        //
+        void PushChangedFields(const json& status)
+        {
+            json changed = json::object();
+
+            auto compare = [this, &changed](const string& field, const json& value) {
+                auto iLast = lastPushed_.find(field);
+                if (iLast == lastPushed_.end() || *iLast != value)
+                {
+                    changed[field] = value;
+                    lastPushed_[field] = value;
+                }
+            };
+
+            if (subscribedFields_.empty())
+            {
+                for (auto& [field, value] : status.items())
+                    compare(field, value);
+            }
+            else
+            {
+                for (auto& field : subscribedFields_)
+                {
+                    auto iValue = status.find(field);
+                    if (iValue != status.end())
+                        compare(field, *iValue);
+                }
+            }
+
+            if (changed.empty()) return;
+
+            auto encoded = json::to_cbor(changed);
+            BuildAndSendResponse(string(encoded.begin(), encoded.end()));
+        }
+
+        //
+        // Send one response, framed as the client expects.  A legacy response
+        // too long for its 16-bit length is replaced by an error, rather
+        // than sent with a wrapped length.
+        //
+        void BuildAndSendResponse(const string& response)
         {
             //cout << "Sending full status: " << response << "\n";
-            try
+            if (!framed_ && response.length() > LegacyMaximumMessageLength)
             {
-                unsigned short bufferLength = response.length();
+                json errorResponse;
+                errorResponse["response"] = {
+                    {"result", "fail"},
+                    {"error", "response too large"},
+                    {"errordetail", "Response exceeds 64 KB; send queries with 32-bit length framing to receive it"}
+                };
+                BuildAndSendResponse(errorResponse.dump());
+                return;
+            }
 
-                string responseWithLength = "  " + response;
-                auto* c_response = const_cast<char*>(responseWithLength.c_str());
+            if (failed_) return;
 
-                *c_response = *(char *)&bufferLength;
-                *(c_response + 1) = *((char *)&bufferLength + 1);
+            // Whole frames are queued behind anything unsent, so a partial
+            // send never leaves the client with half a frame followed by another.
+            if (!HasUnsent())
+            {
+                unsent_.clear();
+                unsentOffset_ = 0;
+                lastSendProgress_ = high_resolution_clock::now();
+            }
+
+            auto headerLength = framed_ ? sizeof(uint32_t) : sizeof(uint16_t);
+            auto offset = unsent_.size();
+            unsent_.resize(offset + headerLength + response.length());
 
-                streamSocket_->snd(c_response, responseWithLength.length());
+            if (framed_)
+            {
+                uint32_t length = htonl(static_cast<uint32_t>(response.length()));
+                memcpy(unsent_.data() + offset, &length, sizeof(length));
             }
-            catch(const std::exception& e)
+            else
             {
-                // Swallow exception:  In the rare case that the client closed
-                // their end just before we send, this will fail.
+                uint16_t length = static_cast<uint16_t>(response.length());
+                memcpy(unsent_.data() + offset, &length, sizeof(length));
             }
+            memcpy(unsent_.data() + offset + headerLength, response.data(), response.length());
+
+            SendUnsent();
         }
 
-        void BuildInputString(string& queryFragment)
+        //
+        // Write as much of the unsent data as the socket takes without blocking,
+        // keeping the rest for when it is writable.  The connection fails if the
+        // client has closed it, or has taken nothing for SendStallTimeout.
+        //
+        void SendUnsent()
         {
-            query_.clear();
+            auto fd = streamSocket_->Fd();
+            auto now = high_resolution_clock::now();
+            while (HasUnsent())
+            {
+                auto sent = send(fd, unsent_.data() + unsentOffset_, unsent_.size() - unsentOffset_, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent < 0)
+                {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+                    cout << "QueryResponseSocket unable to send to " << streamSocket_->Peer() << ": " << std::strerror(errno) << "\n";
+                    failed_ = true;
+                    return;
+                }
+
+                unsentOffset_ += sent;
+                lastSendProgress_ = now;
+            }
 
-            do
+            if (!HasUnsent())
+            {
+                unsent_.clear();
+                unsentOffset_ = 0;
+            }
+            else if (now - lastSendProgress_ > SendStallTimeout)
             {
-                query_ += queryFragment;
+                cout << "QueryResponseSocket disconnecting " << streamSocket_->Peer() << ", which has taken nothing for " << duration_cast<milliseconds>(SendStallTimeout).count() << " ms\n";
+                failed_ = true;
+            }
+        }
 
-                if (queryFragment.size() == 1000)
+        //
+        // Read whatever is available without blocking, appending to the receive buffer.
+        // No more is read once the buffer could hold the largest query; the rest
+        // stays queued in the socket until the buffered queries are extracted.
+        // Return false if the client closed the socket.
+        //
+        bool ReceiveAvailable()
+        {
+            auto fd = streamSocket_->Fd();
+            while (receiveLength_ < sizeof(uint32_t) + MaximumMessageLength)
+            {
+                if (receiveBuffer_.size() - receiveLength_ < ReceiveChunkLength)
+                    receiveBuffer_.resize(receiveLength_ + ReceiveChunkLength);
+
+                auto received = recv(fd, receiveBuffer_.data() + receiveLength_, receiveBuffer_.size() - receiveLength_, MSG_DONTWAIT);
+                if (received > 0)
                 {
-                    queryFragment.clear();
-                    queryFragment.resize(1000);
-                    *streamSocket_ >> queryFragment;
+                    receiveLength_ += received;
+                    continue;
+                }
+
+                if (received == 0) return false;
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+
+            return true;
+        }
+
+        //
+        // If the receive buffer starts with a complete query, move it to query_,
+        // remove it from the buffer, and return true.
+        // A query starting with '{' is a legacy unframed JSON object, and ends
+        // where its braces balance.  Anything else starts with a 32-bit
+        // big-endian length; a length never starts with '{' (0x7b) or
+        // whitespace, as that would exceed the maximum message size.
+        // A framed length beyond that maximum, or a legacy query that grows
+        // beyond the legacy maximum without closing, leaves no way to find the
+        // next query, so the connection fails.
+        //
+        bool ExtractQuery()
+        {
+            // Whitespace between legacy queries is skipped; it can never start a valid length.
+            size_t whitespace { 0 };
+            while (whitespace < receiveLength_ && std::isspace(static_cast<unsigned char>(receiveBuffer_[whitespace])))
+                whitespace++;
+
+            if (whitespace > 0)
+            {
+                memmove(receiveBuffer_.data(), receiveBuffer_.data() + whitespace, receiveLength_ - whitespace);
+                receiveLength_ -= whitespace;
+            }
+
+            if (receiveLength_ == 0) return false;
 
-                    if (!queryFragment.empty()) query_ += queryFragment;
+            size_t start { 0 };
+            size_t length { 0 };
+            if (receiveBuffer_[0] == '{')
+            {
+                length = FindJsonObjectEnd();
+                if (length == 0 || length > LegacyMaximumMessageLength)
+                {
+                    if (length > LegacyMaximumMessageLength || receiveLength_ > LegacyMaximumMessageLength)
+                    {
+                        cout << "QueryResponseSocket disconnecting " << streamSocket_->Peer() << ", which sent an unframed query over " << LegacyMaximumMessageLength << " bytes\n";
+                        failed_ = true;
+                    }
+                    return false;
                 }
-            } while (queryFragment.size() == 1000);
+            }
+            else
+            {
+                if (receiveLength_ < sizeof(uint32_t)) return false;
+
+                uint32_t networkLength {};
+                memcpy(&networkLength, receiveBuffer_.data(), sizeof(networkLength));
+                length = ntohl(networkLength);
+                if (length > MaximumMessageLength)
+                {
+                    cout << "QueryResponseSocket disconnecting " << streamSocket_->Peer() << ", which sent a query with invalid length " << length << "\n";
+                    failed_ = true;
+                    return false;
+                }
+
+                start = sizeof(uint32_t);
+                if (receiveLength_ < start + length) return false;
+
+                framed_ = true;
+            }
+
+            query_.assign(receiveBuffer_.data() + start, length);
+
+            auto consumed = start + length;
+            memmove(receiveBuffer_.data(), receiveBuffer_.data() + consumed, receiveLength_ - consumed);
+            receiveLength_ -= consumed;
+
+            return true;
+        }
+
+        //
+        // Return the length of the complete JSON object at the start of the
+        // receive buffer, or zero if it is not yet complete.
+        //
+        size_t FindJsonObjectEnd() const
+        {
+            int depth { 0 };
+            bool inString { false };
+            bool escaped { false };
+
+            for (size_t i = 0; i < receiveLength_; i++)
+            {
+                auto c = receiveBuffer_[i];
+                if (inString)
+                {
+                    if (escaped) escaped = false;
+                    else if (c == '\\') escaped = true;
+                    else if (c == '"') inString = false;
+                }
+                else if (c == '"') inString = true;
+                else if (c == '{' || c == '[') depth++;
+                else if ((c == '}' || c == ']') && --depth == 0) return i + 1;
+            }
+
+            return 0;
         }
     };
 }
@@ -3,6 +3,9 @@
 #include <iostream>
 #include <string>
 #include <limits>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 #include <filesystem>
 
 #include "nlohmann/json.hpp"
@@ -10,6 +13,9 @@
 #include "IQueryHandler.h"
 #include "IModelRunner.h"
 #include "Recorder.h"
+#include "TickProfiler.h"
+#include "HardwareCounters.h"
+#include "StreamerManager.h"
 #include "Log.h"
 
 namespace embeddedpenguins::core::neuron::model
@@ -17,11 +23,15 @@ namespace embeddedpenguins::core::neuron::model
     using std::cout;
     using std::string;
     using std::numeric_limits;
+    using std::vector;
+    using std::uint8_t;
+    using std::uint32_t;
     using std::filesystem::directory_iterator;
     using std::filesystem::exists;
 
     using nlohmann::json;
 
+    constexpr unsigned long long int NeuronStateMaximumBytes { 16 * 1024 * 1024 };
 
     template<class RECORDTYPE>
     class CommandControlHandler : public IQueryHandler
@@ -44,7 +54,7 @@ namespace embeddedpenguins::core::neuron::model
                 response_.clear();
 
                 auto jsonQuery = json::parse(query);
-                if (!jsonQuery.contains("query") || !jsonQuery["query"].is_string() || jsonQuery["query"].get<string>() != "fullstatus")
+                if (!jsonQuery.contains("query") || !jsonQuery["query"].is_string() || (jsonQuery["query"].get<string>() != "fullstatus" && jsonQuery["query"].get<string>() != "neuronstate"))
                     cout << "HandleQuery: " << jsonQuery << "\n";
 
                 ParseQuery(jsonQuery);
@@ -55,10 +65,21 @@ namespace embeddedpenguins::core::neuron::model
                 json response;
                 response_ = BuildErrorResponse(response, "format", (string(ex.what()) + " parsing json query").c_str()).dump();
             }
+            catch (const std::exception& ex)
+            {
+                cout << "HandleQuery failed to handle query string '" << query << "': " << ex.what() << "\n";
+                json response;
+                response_ = BuildErrorResponse(response, "internal", (string(ex.what()) + " handling query").c_str()).dump();
+            }
             
             return response_;
         }
 
+        virtual json RenderStatus() override
+        {
+            return BuildFullStatusElement();
+        }
+
     private:
         void ParseQuery(const json& jsonQuery)
         {
@@ -74,13 +95,17 @@ namespace embeddedpenguins::core::neuron::model
             else if (query == "dynamicstatus")
                 response_ = BuildDynamicStatusResponse(response).dump();
             else if (query == "runmeasurements")
-                response_ = BuildRunMeasurementsResponse(response).dump();
+                response_ = BuildRunMeasurementsResponse(jsonQuery, response).dump();
             else if (query == "settings")
                 response_ = BuildSettingsResponse(jsonQuery, response).dump();
             else if (query == "control")
                 response_ = BuildControlResponse(jsonQuery, response).dump();
             else if (query == "deploy")
                 response_ = BuildDeployResponse(jsonQuery, response).dump();
+            else if (query == "reload")
+                response_ = BuildReloadResponse(response).dump();
+            else if (query == "neuronstate")
+                response_ = BuildNeuronStateResponse(jsonQuery, response);
             else
                 response_ = BuildErrorResponse(response, "unrecognized", "Json query contains no recognized request").dump();
         }
@@ -107,10 +132,27 @@ namespace embeddedpenguins::core::neuron::model
             return response;
         }
 
-        json& BuildRunMeasurementsResponse(json& response)
+        //
+        // Include the per-stage tick profile and hardware counters of the running model, if any.
+        // With "reset": true, the profile restarts after it is rendered.
+        //
+        json& BuildRunMeasurementsResponse(const json& jsonQuery, json& response)
         {
             json responseResponse;
             responseResponse["runmeasurements"] = runner_.RenderRunMeasurements();
+
+            auto* profile = TickProfiler::Active().load();
+            if (profile != nullptr)
+            {
+                responseResponse["tickprofile"] = profile->Render();
+                if (jsonQuery.contains("reset") && jsonQuery["reset"].is_boolean() && jsonQuery["reset"].get<bool>())
+                    profile->Reset();
+            }
+
+            auto* counters = HardwareCounters::Active().load();
+            if (counters != nullptr)
+                responseResponse["hardwarecounters"] = counters->Render();
+
             responseResponse["result"] = "ok";
 
             response["response"] = responseResponse;
@@ -228,6 +270,42 @@ namespace embeddedpenguins::core::neuron::model
             return response;
         }
 
+        //
+        // Reload the control file without stopping the engine.  Streamers added
+        // to or removed from the 'Execution' section are attached or detached
+        // between ticks; other 'Execution' changes are reported as needing a restart.
+        //
+        json& BuildReloadResponse(json& response)
+        {
+            json reloadResponse;
+
+            auto* streamers = StreamerManager::Active().load();
+            json changes;
+            bool success { false };
+            if (streamers != nullptr)
+            {
+                success = streamers->Reload(changes);
+            }
+            else
+            {
+                json previousControl;
+                auto& configuration = runner_.getConfigurationRepository();
+                success = configuration.ReloadControl(previousControl);
+                if (success)
+                    changes = StreamerChanges::Diff(previousControl, *configuration.Control()).Render();
+            }
+
+            if (!success)
+                return BuildErrorResponse(response, "Reload failure", "Unable to reload the control file");
+
+            reloadResponse["changes"] = changes;
+            reloadResponse["streamersmanaged"] = streamers != nullptr;
+            reloadResponse["result"] = "ok";
+
+            response["response"] = reloadResponse;
+            return response;
+        }
+
         json& BuildDeployResponse(const json& jsonQuery, json& response)
         {
             string modelName {""};
@@ -266,6 +344,124 @@ namespace embeddedpenguins::core::neuron::model
             return response;
         }
 
+        //
+        // Return the state of a block of neurons, selected either as an index range:
+        //
+        //  {"query": "neuronstate", "begin": 0, "count": 1000}
+        //
+        // or as a rectangular window of the model's rows and columns:
+        //
+        //  {"query": "neuronstate", "window": {"row": 10, "column": 20, "width": 50, "height": 40}}
+        //
+        // with "synapses": true to include synaptic strengths.
+        // The state is packed in native byte order into binary blocks, in
+        // neuron order (row by row for a window): activations as int16,
+        // ticks since last spike as uint32 (saturated), and synaptic strengths
+        // as int16, 'synapsesperneuron' per neuron with zero where unused.
+        // The response is encoded as CBOR, since JSON has no binary type;
+        // errors are returned as JSON, as for any other query.
+        // A query whose state would exceed NeuronStateMaximumBytes, counting
+        // synapses if included, is refused before anything is allocated.
+        //
+        string BuildNeuronStateResponse(const json& jsonQuery, json& response)
+        {
+            auto* helper = runner_.Helper();
+            if (helper == nullptr)
+                return BuildErrorResponse(response, "no model", "No model is loaded").dump();
+
+            auto modelSize = static_cast<unsigned long long int>(runner_.ModelSize());
+            auto includeSynapses = jsonQuery.contains("synapses") && jsonQuery["synapses"].is_boolean() && jsonQuery["synapses"].get<bool>();
+
+            // Each span is a contiguous run of neuron indexes: [begin, begin + count).
+            vector<std::pair<unsigned long long int, unsigned long long int>> spans;
+            json neuronStateResponse;
+
+            if (jsonQuery.contains("window"))
+            {
+                auto& windowJson = jsonQuery["window"];
+                if (!windowJson.is_object() || !windowJson.contains("row") || !windowJson.contains("column") || !windowJson.contains("width") || !windowJson.contains("height"))
+                    return BuildErrorResponse(response, "invalid window", "Window must contain 'row', 'column', 'width' and 'height' elements").dump();
+
+                auto row = windowJson["row"].get<unsigned int>();
+                auto column = windowJson["column"].get<unsigned int>();
+                auto width = windowJson["width"].get<unsigned int>();
+                auto height = windowJson["height"].get<unsigned int>();
+                if (static_cast<unsigned long long int>(row) + height > helper->Height() || static_cast<unsigned long long int>(column) + width > helper->Width())
+                    return BuildErrorResponse(response, "invalid window", "Window extends outside the model").dump();
+
+                for (auto windowRow = row; windowRow < row + height; windowRow++)
+                    spans.push_back({ helper->GetIndex(windowRow, column), width });
+
+                neuronStateResponse["window"] = windowJson;
+            }
+            else
+            {
+                unsigned long long int begin { 0 };
+                unsigned long long int count { modelSize };
+                if (jsonQuery.contains("begin")) begin = jsonQuery["begin"].get<unsigned long long int>();
+                if (jsonQuery.contains("count")) count = jsonQuery["count"].get<unsigned long long int>();
+                if (begin > modelSize || count > modelSize - begin)
+                    return BuildErrorResponse(response, "invalid range", "Range extends outside the model").dump();
+
+                spans.push_back({ begin, count });
+                neuronStateResponse["begin"] = begin;
+            }
+
+            unsigned long long int neuronCount { 0 };
+            for (auto& [begin, count] : spans)
+            {
+                if (begin + count > modelSize)
+                    return BuildErrorResponse(response, "invalid window", "Window extends outside the model").dump();
+                neuronCount += count;
+            }
+
+            const unsigned long long int bytesPerNeuron = sizeof(short int) + sizeof(uint32_t) + (includeSynapses ? SynapticConnectionsPerNode * sizeof(short int) : 0);
+            if (neuronCount > NeuronStateMaximumBytes / bytesPerNeuron)
+                return BuildErrorResponse(response, "too many neurons", ("At most " + std::to_string(NeuronStateMaximumBytes / bytesPerNeuron) + " neurons may be returned per query" + (includeSynapses ? " with synapses" : "")).c_str()).dump();
+
+            vector<short int> activations(neuronCount);
+            vector<unsigned long int> ticks(neuronCount);
+            vector<short int> strengths(includeSynapses ? neuronCount * SynapticConnectionsPerNode : 0);
+
+            unsigned long long int offset { 0 };
+            for (auto& [begin, count] : spans)
+            {
+                helper->CopyActivations(begin, count, activations.data() + offset);
+                helper->CopyTicksSinceLastSpike(begin, count, ticks.data() + offset);
+                if (includeSynapses)
+                    helper->CopySynapticStrengths(begin, count, SynapticConnectionsPerNode, strengths.data() + offset * SynapticConnectionsPerNode);
+                offset += count;
+            }
+
+            vector<uint32_t> packedTicks(neuronCount);
+            std::transform(ticks.begin(), ticks.end(), packedTicks.begin(), [](unsigned long int tick) {
+                return static_cast<uint32_t>(std::min<unsigned long int>(tick, numeric_limits<uint32_t>::max()));
+            });
+
+            neuronStateResponse["count"] = neuronCount;
+            neuronStateResponse["iterations"] = runner_.GetIterations();
+            neuronStateResponse["activations"] = PackBinary(activations);
+            neuronStateResponse["tickssincespike"] = PackBinary(packedTicks);
+            if (includeSynapses)
+            {
+                neuronStateResponse["synapsesperneuron"] = SynapticConnectionsPerNode;
+                neuronStateResponse["synapsestrengths"] = PackBinary(strengths);
+            }
+            neuronStateResponse["result"] = "ok";
+
+            response["response"] = neuronStateResponse;
+
+            auto encoded = json::to_cbor(response);
+            return string(encoded.begin(), encoded.end());
+        }
+
+        template<class ELEMENTTYPE>
+        static json PackBinary(const vector<ELEMENTTYPE>& elements)
+        {
+            auto* bytes = reinterpret_cast<const uint8_t*>(elements.data());
+            return json::binary(vector<uint8_t>(bytes, bytes + elements.size() * sizeof(ELEMENTTYPE)));
+        }
+
         json& BuildErrorResponse(json& response, const char* error, const char* errorDetail)
         {
             json errorResponse;
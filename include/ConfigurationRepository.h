@@ -4,23 +4,48 @@
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include <vector>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <system_error>
 
 #include "nlohmann/json.hpp"
 #include "ModelMapper.h"
+#include "RuntimeConfig.h"
+#include "ThreadPlacement.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::string;
     using std::ifstream;
+    using std::vector;
+    using std::set;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::recursive_mutex;
+    using std::lock_guard;
     using std::filesystem::exists;
     using std::filesystem::create_directories;
 
     using nlohmann::json;
     
+    //
+    // The repository is changed from several threads: the control file
+    // watcher and command handler reload it, commands change settings and
+    // names, and streamers being attached compose record paths.  Every change,
+    // and every compile of the RuntimeConfig, is made under one mutex.
+    // The control is never changed in place; a reload publishes a new one,
+    // with the RuntimeConfig compiled from it, so readers keep a consistent copy.
+    //
     class ConfigurationRepository
     {
         ModelMapper expansionMapper_ { };
+        shared_ptr<ThreadRegistry> threads_ { make_shared<ThreadRegistry>() };
+        // Recursive, since the public composing methods call one another.
+        // Copies of the repository share it, as they share the thread registry.
+        shared_ptr<recursive_mutex> mutex_ { make_shared<recursive_mutex>() };
         string defaultStackConfigurationFile_ { "configuration.json" };
         string defaultControlFile_ { "defaultcontrol.json" };
 
@@ -31,9 +56,13 @@ namespace embeddedpenguins::core::neuron::model
         string stackConfigFile_ {};
         string configFile_ {};
         string monitorFile_ {};
+        set<string> createdDirectories_ {};
+        // Counts changes to the configuration, so derived values may be cached until it changes.
+        unsigned long long int generation_ { 0 };
+        RuntimeConfigSlot runtime_ {};
     protected:
         json stackConfiguration_ {};
-        json control_ {};
+        shared_ptr<const json> control_ { make_shared<const json>(json::object()) };
         json settings_ {};
         string modelName_ {};
         string deploymentName_ {};
@@ -45,22 +74,41 @@ namespace embeddedpenguins::core::neuron::model
         string wiringFile_ {};
 
     public:
-        void AddExpansion(const string& engine, unsigned long int start, unsigned long int length)
+        bool AddExpansion(const string& engine, unsigned long int start, unsigned long int length)
         {
-            expansionMapper_.AddExpansion(engine, start, length);
+            lock_guard<recursive_mutex> lock(*mutex_);
+            return expansionMapper_.AddExpansion(engine, start, length);
+        }
+        bool SetStoragePermutation(const vector<unsigned long int>& storageIndexes)
+        {
+            lock_guard<recursive_mutex> lock(*mutex_);
+            return expansionMapper_.SetStoragePermutation(storageIndexes);
         }
         const ModelMapper& ExpansionMap() const { return expansionMapper_; };
-
-        const bool Valid() const { return valid_; }
-        json& Control() { return control_; }
+        // Threads placed for this engine, including those placed inside plugins.
+        // Copies of the repository share the one registry.
+        ThreadRegistry& Threads() { return *threads_; }
+        const ThreadRegistry& Threads() const { return *threads_; }
+
+        const bool Valid() const { lock_guard<recursive_mutex> lock(*mutex_); return valid_; }
+        // The resolved path of the control file, once loaded.
+        string ControlFile() const { lock_guard<recursive_mutex> lock(*mutex_); return controlFile_; }
+        unsigned long long int Generation() const { lock_guard<recursive_mutex> lock(*mutex_); return generation_; }
+        // The compiled configuration; safe to call from any thread.
+        shared_ptr<const RuntimeConfig> Runtime() const { return runtime_.Load(); }
+        // The current control; safe to call from any thread, and to keep
+        // reading after a reload has replaced it.
+        shared_ptr<const json> Control() const { lock_guard<recursive_mutex> lock(*mutex_); return control_; }
+        // Replace the control, as a reload does.
+        void Control(const json& control) { lock_guard<recursive_mutex> lock(*mutex_); PublishControl(control); }
         json& StackConfiguration() { return stackConfiguration_; }
         json& Settings() { return settings_; }
-        const string& ModelName() const { return modelName_; }
-        void ModelName(const string& modelName) { modelName_ = modelName; }
-        const string& DeploymentName() const { return deploymentName_; }
-        void DeploymentName(const string& deploymentName) { deploymentName_ = deploymentName; }
-        const string& EngineName() const { return engineName_; }
-        void EngineName(const string& engineName) { engineName_ = engineName; }
+        string ModelName() const { lock_guard<recursive_mutex> lock(*mutex_); return modelName_; }
+        void ModelName(const string& modelName) { lock_guard<recursive_mutex> lock(*mutex_); modelName_ = modelName; CompileRuntime(); }
+        string DeploymentName() const { lock_guard<recursive_mutex> lock(*mutex_); return deploymentName_; }
+        void DeploymentName(const string& deploymentName) { lock_guard<recursive_mutex> lock(*mutex_); deploymentName_ = deploymentName; CompileRuntime(); }
+        string EngineName() const { lock_guard<recursive_mutex> lock(*mutex_); return engineName_; }
+        void EngineName(const string& engineName) { lock_guard<recursive_mutex> lock(*mutex_); engineName_ = engineName; CompileRuntime(); }
 
     public:
         ConfigurationRepository() = default;
@@ -82,10 +130,12 @@ namespace embeddedpenguins::core::neuron::model
         //
         bool InitializeConfiguration(const string& controlFile)
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             controlFile_ = controlFile;
             valid_ = true;
 
             expansionMapper_.Reset();
+            createdDirectories_.clear();
 
             if (valid_)
                 LoadSettings();
@@ -96,11 +146,47 @@ namespace embeddedpenguins::core::neuron::model
             if (valid_)
                 LoadControl();
 
+            CompileRuntime();
             return valid_;
         }
 
+        //
+        // Reload only the control file, from the path resolved when the
+        // configuration was loaded, leaving the settings and stack configuration
+        // alone.  On success, the control it replaced is returned in previousControl
+        // so the caller can find what changed.  If the file cannot be read,
+        // the current control is kept.
+        //
+        bool ReloadControl(json& previousControl)
+        {
+            lock_guard<recursive_mutex> lock(*mutex_);
+            if (!valid_ || controlFile_.empty() || !exists(controlFile_))
+            {
+                cout << "Control file " << controlFile_ << " does not exist, not reloading\n";
+                return false;
+            }
+
+            json control;
+            try
+            {
+                ifstream controlStream(controlFile_);
+                controlStream >> control;
+            }
+            catch(const json::parse_error& e)
+            {
+                std::cerr << "Unable to reload control file " << controlFile_ << ": " << e.what() << '\n';
+                return false;
+            }
+
+            cout << "Reloaded control from " << controlFile_ << "\n";
+            previousControl = *control_;
+            PublishControl(std::move(control));
+            return true;
+        }
+
         void UpdateSetting(const string& settingsKey, const string& settingsValue)
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             if (settings_.contains(settingsKey))
             {
                 cout << "Changing setting '" << settingsKey << "' to '" << settingsValue << "'\n";
@@ -109,6 +195,8 @@ namespace embeddedpenguins::core::neuron::model
                 // If we changed the cached paths, clear the path cache so it will need to be recalculated.
                 if (settingsKey == "RecordFilePath") recordDirectoryRead_ = false;
                 if (settingsKey == "RecordFileCachePath") recordCacheDirectory_.clear();
+
+                CompileRuntime();
             }
         }
 
@@ -118,6 +206,7 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ComposeRecordCachePath()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             return ComposeRecordPathForModel(ExtractRecordCacheDirectory(), ExtractRecordFile());
         }
 
@@ -127,6 +216,7 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ComposeRecordPath()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             auto recordDirectory = ExtractRecordDirectory();
             if (recordDirectory.empty()) return recordDirectory;
 
@@ -139,6 +229,7 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ComposeWiringCachePath()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             return ComposeRecordPathForModel(ExtractRecordCacheDirectory(), ExtractRecordWiringFile());
         }
 
@@ -149,6 +240,7 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ExtractRecordCacheDirectory()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             string recordCacheDirectory = recordCacheDirectory_;
 
             // Read and cache the directory only on the first call.
@@ -185,6 +277,7 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ExtractRecordDirectory()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             // Read and cache the directory only on the first call.
             if (!recordDirectoryRead_)
             {
@@ -212,14 +305,26 @@ namespace embeddedpenguins::core::neuron::model
 
         //
         //  Given a bsse directory for a record path, compose the standard subdirectory,
-        // based on the current model name and other relevant parameters.
+        // based on the current model name and other relevant parameters, for a file
+        // about to be opened there.
+        // Each directory is created only the first time it is composed
+        // after the configuration is loaded; a failure is retried next time.
         //
         const string ComposeRecordPathForModel(const string baseDirectory, const string fileName)
         {
-            string recordPath = baseDirectory;
-            recordPath += modelName_ + "/" + deploymentName_ + "/" + engineName_ + "/";
+            lock_guard<recursive_mutex> lock(*mutex_);
+            auto recordPath = RecordDirectoryForModel(baseDirectory);
 
-            create_directories(recordPath);
+            if (createdDirectories_.insert(recordPath).second)
+            {
+                std::error_code error;
+                create_directories(recordPath, error);
+                if (error)
+                {
+                    cout << "Unable to create record directory " << recordPath << ": " << error.message() << "\n";
+                    createdDirectories_.erase(recordPath);
+                }
+            }
 
             return recordPath + fileName;
         }
@@ -231,6 +336,7 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ExtractRecordFile()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             string fileName = recordFile_;
             if (fileName.empty())
             {
@@ -242,7 +348,7 @@ namespace embeddedpenguins::core::neuron::model
                         fileName = defaultRecordFileJson.get<string>();
                 }
 
-                if (control_.contains("RecordFile"))
+                if (control_->contains("RecordFile"))
                 {
                     auto& recordFileJson = settings_["RecordFile"];
                     if (recordFileJson.is_string())
@@ -266,13 +372,14 @@ namespace embeddedpenguins::core::neuron::model
         //
         const string ExtractRecordWiringFile()
         {
+            lock_guard<recursive_mutex> lock(*mutex_);
             string fileName = wiringFile_;
             if (fileName.empty())
             {
                 fileName = "wiring.csv";
-                if (control_.contains("Wiring"))
+                if (control_->contains("Wiring"))
                 {
-                    auto& wiringJson = control_["Wiring"];
+                    auto& wiringJson = (*control_)["Wiring"];
                     if (wiringJson.is_string())
                         fileName = wiringJson.get<string>();
 
@@ -286,7 +393,61 @@ namespace embeddedpenguins::core::neuron::model
             return fileName;
         }
 
+        //
+        //  Compile the current settings, control and stack configuration into
+        // a new RuntimeConfig, and publish it.  Call after any change.
+        // Paths are only resolved here; their directories are created when
+        // a file is first opened in them, through the Compose methods.
+        //
+        void CompileRuntime()
+        {
+            lock_guard<recursive_mutex> lock(*mutex_);
+            auto runtime = make_shared<RuntimeConfig>();
+            runtime->Generation = ++generation_;
+            runtime->Valid = valid_;
+            runtime->ModelName = modelName_;
+            runtime->DeploymentName = deploymentName_;
+            runtime->EngineName = engineName_;
+            runtime->Control = control_;
+
+            if (valid_)
+            {
+                auto recordDirectory = ExtractRecordDirectory();
+                auto recordCacheDirectory = RecordDirectoryForModel(ExtractRecordCacheDirectory());
+                runtime->RecordPath = recordDirectory.empty() ? recordDirectory : RecordDirectoryForModel(recordDirectory) + ExtractRecordFile();
+                runtime->RecordCachePath = recordCacheDirectory + ExtractRecordFile();
+                runtime->WiringCachePath = recordCacheDirectory + ExtractRecordWiringFile();
+                runtime->Services = RuntimeConfig::ParseServices(stackConfiguration_);
+                runtime->OutputStreamers = RuntimeConfig::ParseOutputStreamers(*control_);
+            }
+
+            runtime_.Store(runtime);
+        }
+
     private:
+        //
+        // With the lock held.  The standard subdirectory of a base directory
+        // for the current model, without creating it.
+        //
+        string RecordDirectoryForModel(const string& baseDirectory) const
+        {
+            return baseDirectory + modelName_ + "/" + deploymentName_ + "/" + engineName_ + "/";
+        }
+
+        //
+        // With the lock held.  Publish a new control, and the configuration compiled from it.
+        //
+        void PublishControl(json control)
+        {
+            control_ = make_shared<const json>(std::move(control));
+
+            // These are cached from the control file.
+            recordFile_.clear();
+            wiringFile_.clear();
+
+            CompileRuntime();
+        }
+
         //
         // Load the settings from the JSON file speicified by the settingsFile_
         // field into the settings_ field.  As a side effect, also load the 'ConfigFilePath'
@@ -410,8 +571,10 @@ namespace embeddedpenguins::core::neuron::model
             cout << "LoadControl from " << controlFile_ << "\n";
             try
             {
-                ifstream control(controlFile_);
-                control >> control_;
+                json control;
+                ifstream controlStream(controlFile_);
+                controlStream >> control;
+                control_ = make_shared<const json>(std::move(control));
             }
             catch(const json::parse_error& e)
             {
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <functional>
+#include <filesystem>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "EventSet.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::function;
+    using std::filesystem::path;
+
+    //
+    // Watch the control file, and call back when it has been rewritten.
+    // The file's directory is watched rather than the file itself, since
+    // editors and deployment tools often replace a file by renaming a new
+    // one over it, which would end a watch on the old file.
+    //
+    // Implements the EventWorkerThread contract:
+    //
+    //  ControlFileWatcher watcher(configuration.ControlFile(), [&configuration]() {
+    //      json changes;
+    //      if (auto* streamers = StreamerManager::Active().load()) streamers->Reload(changes);
+    //  });
+    //  EventWorkerThread<ControlFileWatcher> watcherThread(watcher);
+    //  watcherThread.StartContinuous();
+    //
+    // The callback runs on the watcher thread.
+    //
+    class ControlFileWatcher
+    {
+        string directory_ {};
+        string fileName_ {};
+        function<void()> onChanged_;
+        int inotifyFd_ { -1 };
+        int watch_ { -1 };
+
+    public:
+        ControlFileWatcher(const string& controlFile, function<void()> onChanged) :
+            onChanged_(onChanged)
+        {
+            path controlPath(controlFile);
+            directory_ = controlPath.has_parent_path() ? controlPath.parent_path().string() : string(".");
+            fileName_ = controlPath.filename().string();
+        }
+
+        ControlFileWatcher(const ControlFileWatcher& other) = delete;
+        ControlFileWatcher& operator=(const ControlFileWatcher& other) = delete;
+        ControlFileWatcher(ControlFileWatcher&& other) noexcept = delete;
+        ControlFileWatcher& operator=(ControlFileWatcher&& other) noexcept = delete;
+
+        void Attach(EventSet& events)
+        {
+            inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotifyFd_ < 0)
+            {
+                cout << "ControlFileWatcher unable to initialize inotify: " << std::strerror(errno) << "\n";
+                return;
+            }
+
+            watch_ = inotify_add_watch(inotifyFd_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if (watch_ < 0)
+            {
+                cout << "ControlFileWatcher unable to watch " << directory_ << ": " << std::strerror(errno) << "\n";
+                return;
+            }
+
+            events.Add(inotifyFd_);
+            cout << "ControlFileWatcher watching " << fileName_ << " in " << directory_ << "\n";
+        }
+
+        void Process(EventSet& events)
+        {
+            if (inotifyFd_ < 0 || !events.IsReady(inotifyFd_)) return;
+
+            // Several writes may be queued; reload once for all of them.
+            bool changed { false };
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(inotifyFd_, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* next = buffer; next < buffer + length; )
+                {
+                    auto* event = reinterpret_cast<inotify_event*>(next);
+                    if (event->len > 0 && fileName_ == event->name)
+                        changed = true;
+
+                    next += sizeof(inotify_event) + event->len;
+                }
+            }
+
+            if (changed)
+            {
+                cout << "ControlFileWatcher detected change to " << fileName_ << "\n";
+                onChanged_();
+            }
+        }
+
+        void Cleanup()
+        {
+            if (inotifyFd_ >= 0)
+                close(inotifyFd_);
+
+            inotifyFd_ = -1;
+            watch_ = -1;
+        }
+    };
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::vector;
+    using std::find;
+    using std::uint64_t;
+
+    //
+    // A wakeup that can be waited on like any other file descriptor.
+    // Signal() may be called from any thread, any number of times;
+    // the waiter sees one readable event until it calls Clear().
+    //
+    class EventSignal
+    {
+        int eventFd_ { -1 };
+
+    public:
+        int Fd() const { return eventFd_; }
+
+    public:
+        EventSignal() :
+            eventFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+        {
+            if (eventFd_ < 0)
+                cout << "EventSignal unable to create eventfd\n";
+        }
+
+        EventSignal(const EventSignal& other) = delete;
+        EventSignal& operator=(const EventSignal& other) = delete;
+        EventSignal(EventSignal&& other) noexcept = delete;
+        EventSignal& operator=(EventSignal&& other) noexcept = delete;
+
+        ~EventSignal()
+        {
+            if (eventFd_ >= 0) close(eventFd_);
+        }
+
+        void Signal()
+        {
+            uint64_t increment { 1 };
+            auto written = write(eventFd_, &increment, sizeof(increment));
+            (void)written;
+        }
+
+        void Clear()
+        {
+            uint64_t count { };
+            auto received = read(eventFd_, &count, sizeof(count));
+            (void)received;
+        }
+
+        //
+        // Block until signaled, without consuming the signal.
+        //
+        void Wait() const
+        {
+            pollfd pollFd { eventFd_, POLLIN, 0 };
+            while (poll(&pollFd, 1, -1) < 0 && errno == EINTR) ;
+        }
+    };
+
+    //
+    // A set of file descriptors to wait on together, using epoll.
+    // After Wait() returns, the descriptors that became readable
+    // are available from Ready().
+    // The epoll descriptor is itself readable whenever any member
+    // descriptor is ready, so one set may be nested in another wait.
+    //
+    class EventSet
+    {
+        int epollFd_ { -1 };
+        vector<epoll_event> events_ { };
+        vector<int> ready_ { };
+
+    public:
+        int Fd() const { return epollFd_; }
+        const vector<int>& Ready() const { return ready_; }
+        bool IsReady(int fd) const { return find(ready_.begin(), ready_.end(), fd) != ready_.end(); }
+
+    public:
+        EventSet() :
+            epollFd_(epoll_create1(EPOLL_CLOEXEC))
+        {
+            if (epollFd_ < 0)
+                cout << "EventSet unable to create epoll instance\n";
+        }
+
+        EventSet(const EventSet& other) = delete;
+        EventSet& operator=(const EventSet& other) = delete;
+        EventSet(EventSet&& other) noexcept = delete;
+        EventSet& operator=(EventSet&& other) noexcept = delete;
+
+        ~EventSet()
+        {
+            if (epollFd_ >= 0) close(epollFd_);
+        }
+
+        //
+        // Wait for the descriptor to become readable.
+        //
+        bool Add(int fd)
+        {
+            epoll_event event { };
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0)
+            {
+                cout << "EventSet unable to add fd " << fd << "\n";
+                return false;
+            }
+
+            events_.resize(events_.size() + 1);
+            return true;
+        }
+
+        //
+        // Stop waiting for the descriptor.  Must be called before the descriptor is closed.
+        //
+        bool Remove(int fd)
+        {
+            if (epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr) != 0)
+                return false;
+
+            if (!events_.empty()) events_.resize(events_.size() - 1);
+
+            // Blank rather than erase, so a caller iterating Ready() is not invalidated,
+            // and a recycled descriptor number is not mistaken as ready.
+            std::replace(ready_.begin(), ready_.end(), fd, -1);
+            return true;
+        }
+
+        //
+        // Wait up to timeoutMilliseconds (forever if negative) for any
+        // descriptor in the set to be readable.  Return the number ready.
+        //
+        int Wait(int timeoutMilliseconds)
+        {
+            ready_.clear();
+            if (events_.empty()) return 0;
+
+            auto count = epoll_wait(epollFd_, events_.data(), events_.size(), timeoutMilliseconds);
+            for (auto i = 0; i < count; i++)
+                ready_.push_back(events_[i].data.fd);
+
+            return ready_.size();
+        }
+    };
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <cerrno>
+
+#include <poll.h>
+
+#include "EventSet.h"
+#include "ThreadPlacement.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::thread;
+    using std::mutex;
+    using std::condition_variable;
+    using std::unique_lock;
+    using std::lock_guard;
+    using std::pair;
+
+    //
+    // A variant of WorkerThread for tasks that wait on their own event sources.
+    // Instead of polling Process() on a timer, the thread sleeps in the kernel
+    // until either one of the implementation's descriptors is readable, or
+    // the client thread sends a control request.  Control requests are
+    // delivered through an eventfd waited on alongside the implementation's
+    // descriptors, so the thread wakes immediately and uses no CPU while idle.
+    // The specialization of the task is provided by IMPLEMENTATIONTYPE,
+    // which must implement these methods:
+    //
+    //void Attach(EventSet& events);     // Called once on the new thread: add descriptors to wait on.
+    //void Process(EventSet& events);    // Called when descriptors in events.Ready() are readable.
+    //void Cleanup();
+    //
+    // As with WorkerThread, an optional placement is applied and an optional
+    // ThreadStart() method is called on the new thread before the constructor returns.
+    //
+    // The implementation may add and remove descriptors from the event set
+    // at any time while on the worker thread.
+    //
+    // As with WorkerThread, no interface enforces the methods; a missing
+    // or malformed method fails at compile time.
+    //
+    template<class IMPLEMENTATIONTYPE>
+    class EventWorkerThread
+    {
+        enum class WorkCode
+        {
+            Run,
+            StartContinuous,
+            StopContinuous,
+            Quit,
+            Scan
+        };
+
+        mutex mutex_ {};
+        mutex mutexReturn_ {};
+        condition_variable cvReturn_ {};
+        bool cycleDone_{false};
+        bool firstScan_ { true };
+        bool started_ { false };
+
+        WorkCode code_{WorkCode::Run};
+        EventSignal control_ {};
+        EventSet events_ {};
+        thread workerThread_;
+
+        IMPLEMENTATIONTYPE& implementation_;
+        const ThreadPlacement placement_;
+
+    public:
+        EventWorkerThread(IMPLEMENTATIONTYPE& implementation, const ThreadPlacement& placement = ThreadPlacement { }) :
+            implementation_(implementation),
+            placement_(placement)
+        {
+            workerThread_ = thread(std::ref(*this));
+            WaitForStart();
+        }
+
+        ~EventWorkerThread()
+        {
+            Join();
+            implementation_.Cleanup();
+        }
+
+        const IMPLEMENTATIONTYPE& GetImplementation() const {
+            return implementation_;
+        }
+
+        //
+        // The thread class calls this method on the new thread.
+        //
+        void operator() ()
+        {
+            Start();
+            implementation_.Attach(events_);
+
+            auto continuous {false};
+            auto quit {false};
+            while (!quit)
+            {
+                auto [controlReady, eventsReady] = WaitForEvents(continuous);
+
+                if (controlReady)
+                {
+                    switch (TakeCode())
+                    {
+                        case WorkCode::StartContinuous:
+                            continuous = true;
+                            break;
+
+                        case WorkCode::StopContinuous:
+                            continuous = false;
+                            SignalDone();
+                            break;
+
+                        case WorkCode::Scan:
+                            events_.Wait(0);
+                            implementation_.Process(events_);
+                            SignalDone();
+                            break;
+
+                        case WorkCode::Quit:
+                            quit = true;
+                            break;
+
+                        default:
+                            break;
+                    }
+                }
+
+                if (eventsReady && continuous && !quit)
+                {
+                    if (events_.Wait(0) > 0)
+                        implementation_.Process(events_);
+                }
+            }
+
+            SignalDone();
+        }
+
+        //
+        // Callable from client thread to ensure no work is ongoing.
+        //
+        void WaitForPreviousScan()
+        {
+            if (firstScan_)
+                return;
+
+            unique_lock<mutex> lock(mutexReturn_);
+            cvReturn_.wait(lock, [this]{ return cycleDone_; });
+        }
+
+        //
+        // Callable from client thread to start new work.
+        //
+        void Scan()
+        {
+            Scan(WorkCode::Scan);
+        }
+
+        //
+        // Callable from client thread to start continuous new work.
+        //
+        void StartContinuous()
+        {
+            Scan(WorkCode::StartContinuous);
+        }
+
+        //
+        // Callable from client thread to stop continuous new work.
+        //
+        void StopContinuous()
+        {
+            Scan(WorkCode::StopContinuous);
+        }
+
+    private:
+        /////////////////////////// Called from worker thread /////////////////////////
+        //
+        // Place this thread, let the implementation allocate its
+        // buffers here, then release the constructor.
+        //
+        void Start()
+        {
+            if (!placement_.Empty() || !placement_.Name.empty())
+                placement_.Apply();
+
+            if constexpr (requires { implementation_.ThreadStart(); })
+                implementation_.ThreadStart();
+
+            {
+                lock_guard<mutex> lock(mutexReturn_);
+                started_ = true;
+            }
+            cvReturn_.notify_one();
+        }
+
+        //
+        // Sleep until the control signal is raised or, if running continuously,
+        // until any of the implementation's descriptors is readable.
+        // Return which of the two woke us.
+        //
+        pair<bool, bool> WaitForEvents(bool continuous)
+        {
+            pollfd pollFds[2] {
+                { control_.Fd(), POLLIN, 0 },
+                { events_.Fd(), POLLIN, 0 }
+            };
+
+            auto count = poll(pollFds, continuous ? 2 : 1, -1);
+            if (count < 0)
+                return { false, false };
+
+            return { (pollFds[0].revents & POLLIN) != 0, continuous && (pollFds[1].revents & POLLIN) != 0 };
+        }
+
+        WorkCode TakeCode()
+        {
+            control_.Clear();
+
+            lock_guard<mutex> lock(mutex_);
+            firstScan_ = false;
+            return code_;
+        }
+
+        void SignalDone()
+        {
+            {
+                lock_guard<mutex> lock(mutexReturn_);
+                cycleDone_ = true;
+            }
+            cvReturn_.notify_one();
+        }
+
+        /////////////////////////// Called from client thread /////////////////////////
+        void WaitForStart()
+        {
+            unique_lock<mutex> lock(mutexReturn_);
+            cvReturn_.wait(lock, [this]{ return started_; });
+        }
+
+        void Scan(WorkCode code)
+        {
+            // If running continuous, will not finish previous scan, don't wait.
+            if (code_ != WorkCode::StartContinuous)
+                WaitForPreviousScan();
+
+            SetDataForScan(code);
+
+            control_.Signal();
+        }
+
+        void SetDataForScan(WorkCode code)
+        {
+            lock_guard<mutex> lock(mutex_);
+            code_ = code;
+            cycleDone_ = false;
+        }
+
+        void Join()
+        {
+            Scan(WorkCode::Quit);
+            workerThread_.join();
+        }
+    };
+}
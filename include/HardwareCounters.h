@@ -0,0 +1,336 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "nlohmann/json.hpp"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::atomic;
+    using std::memory_order_relaxed;
+    using std::mutex;
+    using std::lock_guard;
+    using std::uint64_t;
+
+    using nlohmann::json;
+
+    //
+    // Hardware counter totals over one sampling interval of engine ticks.
+    //
+    struct HardwareCounterSample
+    {
+        unsigned long long int Ticks {};
+        uint64_t Cycles {};
+        uint64_t Instructions {};
+        uint64_t CacheMisses {};
+        uint64_t BranchMisses {};
+        unsigned long long int Spikes {};
+        unsigned long long int Synapses {};
+        uint64_t TimeEnabled {};
+        uint64_t TimeRunning {};
+    };
+
+    //
+    // A group of CPU hardware counters (cycles, instructions, last-level
+    // cache misses and branch misses) bound to the engine thread with
+    // perf_event_open, counting user mode only.
+    // The engine calls Tick() once per tick with the work it did; every
+    // N ticks the group is read once, and the interval is published as an
+    // immutable sample that any thread may render.
+    //
+    // If the kernel or hardware disallows perf events (perf_event_paranoid,
+    // containers, virtual machines), the counters are simply unavailable,
+    // and the reason is rendered instead.  A counter the hardware lacks
+    // is left out of the group, and rendered as zero.
+    //
+    // When there are more events than hardware counters, the kernel
+    // multiplexes the group, and it only counts part of the time.  Counts
+    // are scaled up by the time enabled over the time running, and the
+    // fraction of time running is rendered, so that scaled counts are
+    // recognizable as estimates.
+    //
+    // A copy holds the source's latest sample, and counts nothing.
+    //
+    class HardwareCounters
+    {
+        enum Counter { Cycles, Instructions, CacheMisses, BranchMisses, CounterCount };
+
+        int fds_[CounterCount] { -1, -1, -1, -1 };
+        int groupIndexes_[CounterCount] { -1, -1, -1, -1 };
+        int groupSize_ { 0 };
+
+        atomic<unsigned int> sampleTicks_ { 1'000 };
+        HardwareCounterSample interval_ { };
+        uint64_t last_[CounterCount] { };
+        uint64_t lastEnabled_ { 0 };
+        uint64_t lastRunning_ { 0 };
+
+        atomic<bool> available_ { false };
+        atomic<bool> frozen_ { false };
+        mutable mutex reasonMutex_ { };
+        string reason_ { "not opened" };
+        atomic<shared_ptr<const HardwareCounterSample>> sample_ { make_shared<const HardwareCounterSample>() };
+        atomic<shared_ptr<const HardwareCounterSample>> total_ { make_shared<const HardwareCounterSample>() };
+
+    public:
+        bool Available() const { return available_; }
+
+    public:
+        HardwareCounters() = default;
+
+        HardwareCounters(const HardwareCounters& other) :
+            sampleTicks_(other.sampleTicks_.load()),
+            frozen_(other.available_ || other.frozen_),
+            reason_(other.Reason()),
+            sample_(other.sample_.load()),
+            total_(other.total_.load())
+        {
+        }
+
+        HardwareCounters& operator=(const HardwareCounters& other)
+        {
+            if (this != &other)
+            {
+                Close();
+                sampleTicks_ = other.sampleTicks_.load();
+                frozen_ = other.available_ || other.frozen_;
+                SetReason(other.Reason());
+                sample_ = other.sample_.load();
+                total_ = other.total_.load();
+            }
+
+            return *this;
+        }
+
+        ~HardwareCounters()
+        {
+            Close();
+        }
+
+        //
+        // Call from the engine thread to start counting on that thread,
+        // publishing a sample every sampleTicks ticks.
+        // Return false, with a reason, if counters are unavailable.
+        //
+        bool Open(unsigned int sampleTicks)
+        {
+            Close();
+            frozen_ = false;
+            sampleTicks_ = sampleTicks > 0 ? sampleTicks : 1;
+
+            fds_[Cycles] = OpenCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+            if (fds_[Cycles] < 0)
+            {
+                auto error = errno;
+                auto reason = string("perf_event_open failed: ") + std::strerror(error);
+                if (error == EACCES || error == EPERM)
+                    reason += " (check /proc/sys/kernel/perf_event_paranoid)";
+                SetReason(reason);
+                cout << "Hardware counters unavailable, " << reason << "\n";
+                return false;
+            }
+
+            groupIndexes_[Cycles] = groupSize_++;
+            fds_[Instructions] = OpenCounter(PERF_COUNT_HW_INSTRUCTIONS, fds_[Cycles]);
+            if (fds_[Instructions] >= 0) groupIndexes_[Instructions] = groupSize_++;
+            fds_[CacheMisses] = OpenCounter(PERF_COUNT_HW_CACHE_MISSES, fds_[Cycles]);
+            if (fds_[CacheMisses] >= 0) groupIndexes_[CacheMisses] = groupSize_++;
+            fds_[BranchMisses] = OpenCounter(PERF_COUNT_HW_BRANCH_MISSES, fds_[Cycles]);
+            if (fds_[BranchMisses] >= 0) groupIndexes_[BranchMisses] = groupSize_++;
+
+            ioctl(fds_[Cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds_[Cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+            interval_ = HardwareCounterSample { };
+            total_ = make_shared<const HardwareCounterSample>();
+            ReadGroup(last_, lastEnabled_, lastRunning_);
+
+            SetReason("");
+            available_ = true;
+            cout << "Hardware counters opened with " << groupSize_ << " counters, sampling every " << sampleTicks_ << " ticks\n";
+            return true;
+        }
+
+        void Close()
+        {
+            for (auto& fd : fds_)
+            {
+                if (fd >= 0) close(fd);
+                fd = -1;
+            }
+
+            for (auto& groupIndex : groupIndexes_)
+                groupIndex = -1;
+
+            groupSize_ = 0;
+            if (available_.exchange(false))
+                SetReason("closed");
+        }
+
+        //
+        // Engine thread only.  Account one tick's work, and publish a sample
+        // if the interval is complete.  Costs one branch when unavailable.
+        //
+        void Tick(unsigned long long int spikes, unsigned long long int synapses)
+        {
+            if (!available_) return;
+
+            interval_.Ticks++;
+            interval_.Spikes += spikes;
+            interval_.Synapses += synapses;
+
+            if (interval_.Ticks >= sampleTicks_.load(memory_order_relaxed))
+                Publish();
+        }
+
+        //
+        // Any thread.  Render the latest interval and the totals since opening.
+        //
+        json Render() const
+        {
+            if (!available_ && !frozen_)
+                return json { {"available", false}, {"reason", Reason()} };
+
+            return json {
+                {"available", true},
+                {"sampleticks", sampleTicks_.load()},
+                {"interval", RenderSample(*sample_.load())},
+                {"total", RenderSample(*total_.load())}
+            };
+        }
+
+        //
+        // The hardware counters of the running model, if any.
+        //
+        static atomic<HardwareCounters*>& Active()
+        {
+            static atomic<HardwareCounters*> active { nullptr };
+            return active;
+        }
+
+    private:
+        string Reason() const
+        {
+            lock_guard<mutex> lock(reasonMutex_);
+            return reason_;
+        }
+
+        void SetReason(const string& reason)
+        {
+            lock_guard<mutex> lock(reasonMutex_);
+            reason_ = reason;
+        }
+
+        static int OpenCounter(uint64_t config, int groupFd)
+        {
+            perf_event_attr attributes { };
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof(attributes);
+            attributes.config = config;
+            attributes.disabled = groupFd < 0 ? 1 : 0;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+        }
+
+        //
+        // Read every counter in the group with one system call.
+        // The group is laid out as { count, time enabled, time running, values... }.
+        //
+        bool ReadGroup(uint64_t (&values)[CounterCount], uint64_t& timeEnabled, uint64_t& timeRunning)
+        {
+            uint64_t buffer[3 + CounterCount] { };
+            if (read(fds_[Cycles], buffer, sizeof(uint64_t) * (3 + groupSize_)) <= 0)
+                return false;
+
+            timeEnabled = buffer[1];
+            timeRunning = buffer[2];
+            for (auto counter = 0; counter < CounterCount; counter++)
+                values[counter] = groupIndexes_[counter] >= 0 ? buffer[3 + groupIndexes_[counter]] : 0;
+
+            return true;
+        }
+
+        void Publish()
+        {
+            uint64_t now[CounterCount] { };
+            uint64_t enabled { 0 };
+            uint64_t running { 0 };
+            if (ReadGroup(now, enabled, running))
+            {
+                interval_.TimeEnabled = enabled - lastEnabled_;
+                interval_.TimeRunning = running - lastRunning_;
+                auto scale = [this](uint64_t delta) {
+                    if (interval_.TimeRunning == 0) return uint64_t { 0 };
+                    if (interval_.TimeRunning >= interval_.TimeEnabled) return delta;
+                    return static_cast<uint64_t>((double)delta * interval_.TimeEnabled / interval_.TimeRunning);
+                };
+
+                interval_.Cycles = scale(now[Cycles] - last_[Cycles]);
+                interval_.Instructions = scale(now[Instructions] - last_[Instructions]);
+                interval_.CacheMisses = scale(now[CacheMisses] - last_[CacheMisses]);
+                interval_.BranchMisses = scale(now[BranchMisses] - last_[BranchMisses]);
+                std::memcpy(last_, now, sizeof(last_));
+                lastEnabled_ = enabled;
+                lastRunning_ = running;
+
+                auto total = make_shared<HardwareCounterSample>(*total_.load());
+                total->Ticks += interval_.Ticks;
+                total->Cycles += interval_.Cycles;
+                total->Instructions += interval_.Instructions;
+                total->CacheMisses += interval_.CacheMisses;
+                total->BranchMisses += interval_.BranchMisses;
+                total->Spikes += interval_.Spikes;
+                total->Synapses += interval_.Synapses;
+                total->TimeEnabled += interval_.TimeEnabled;
+                total->TimeRunning += interval_.TimeRunning;
+
+                sample_ = make_shared<const HardwareCounterSample>(interval_);
+                total_ = shared_ptr<const HardwareCounterSample>(total);
+            }
+
+            interval_ = HardwareCounterSample { };
+        }
+
+        static json RenderSample(const HardwareCounterSample& sample)
+        {
+            auto ratio = [](uint64_t numerator, unsigned long long int denominator) {
+                return denominator > 0 ? (double)numerator / (double)denominator : 0.0;
+            };
+
+            return json {
+                {"ticks", sample.Ticks},
+                {"cycles", sample.Cycles},
+                {"instructions", sample.Instructions},
+                {"cachemisses", sample.CacheMisses},
+                {"branchmisses", sample.BranchMisses},
+                {"spikes", sample.Spikes},
+                {"synapses", sample.Synapses},
+                {"ipc", ratio(sample.Instructions, sample.Cycles)},
+                {"cachemissesperspike", ratio(sample.CacheMisses, sample.Spikes)},
+                {"cachemissespersynapse", ratio(sample.CacheMisses, sample.Synapses)},
+                {"branchmissesperspike", ratio(sample.BranchMisses, sample.Spikes)},
+                {"branchmissespersynapse", ratio(sample.BranchMisses, sample.Synapses)},
+                {"runningfraction", sample.TimeEnabled > 0 ? (double)sample.TimeRunning / (double)sample.TimeEnabled : 0.0}
+            };
+        }
+    };
+}
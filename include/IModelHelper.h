@@ -8,6 +8,8 @@
 
 #include "ModelMapper.h"
 #include "NeuronRecordCommon.h"
+#include "NeuronRecordBuffer.h"
+#include "OutputInterest.h"
 #include "CoreCommon.h"
 
 //
@@ -47,8 +49,55 @@ namespace embeddedpenguins::core::neuron::model
         virtual void Wire(unsigned long int sourceNodeIndex, unsigned long int targetNodeIndex, int synapticWeight, SynapseType type) = 0;
         virtual short GetNeuronActivation(const unsigned long int source) const = 0;
         virtual vector<tuple<unsigned long long, short int, short int, unsigned short, short int, NeuronRecordType>> CollectRelevantNeurons(bool includeSynapses, bool includeActivation, bool includeHypersensitive) = 0;
+
+        // Append this tick's relevant records to a caller-owned buffer, which is reused
+        // from tick to tick.  Carriers should override this to write the buffer directly;
+        // the default adapts CollectRelevantNeurons() above.
+        virtual void CollectRelevantRecords(NeuronRecordBuffer& records, bool includeSynapses, bool includeActivation, bool includeHypersensitive)
+        {
+            for (auto& [neuronIndex, activation, hypersensitive, synapseIndex, synapseStrength, type] : CollectRelevantNeurons(includeSynapses, includeActivation, includeHypersensitive))
+                records.Add(neuronIndex, activation, hypersensitive, synapseIndex, synapseStrength, type);
+        }
+
+        // Append only the records the attached outputs are interested in for this tick,
+        // and mark the buffer with the tick.
+        // Nothing is collected for an empty interest, or on a tick it does not sample.
+        // Carriers should override this to skip unwanted neurons and record types
+        // while scanning; the default filters what CollectRelevantRecords() collects.
+        // The interest's neuron ranges are of local indexes, not storage indexes.
+        virtual void CollectInterestingRecords(unsigned long long int tick, NeuronRecordBuffer& records, const OutputInterest& interest)
+        {
+            records.Tick = tick;
+            if (interest.Empty() || !interest.WantsTick(tick)) return;
+
+            auto from = records.Size();
+            CollectRelevantRecords(records, interest.Synapses, interest.Activation, interest.Hypersensitive);
+            interest.Filter(records, GetExpansionMap(), from);
+        }
         virtual unsigned long int FindRequiredSynapseCounts() = 0;
 
+        // Bulk state access.  Carriers that keep state in contiguous (or device)
+        // memory should override these; the defaults go one neuron at a time.
+        virtual void CopyActivations(unsigned long long int begin, unsigned long long int count, short int* activations) const
+        {
+            for (unsigned long long int offset = 0; offset < count; offset++)
+                activations[offset] = GetNeuronActivation(begin + offset);
+        }
+
+        virtual void CopyTicksSinceLastSpike(unsigned long long int begin, unsigned long long int count, unsigned long int* ticks) const
+        {
+            for (unsigned long long int offset = 0; offset < count; offset++)
+                ticks[offset] = GetNeuronTicksSinceLastSpike(begin + offset);
+        }
+
+        // Strengths of synapses 0 to synapsesPerNeuron-1 of each neuron, zero where unused.
+        virtual void CopySynapticStrengths(unsigned long long int begin, unsigned long long int count, unsigned int synapsesPerNeuron, short int* strengths) const
+        {
+            for (unsigned long long int offset = 0; offset < count; offset++)
+                for (unsigned int synapseId = 0; synapseId < synapsesPerNeuron; synapseId++)
+                    *strengths++ = IsSynapseUsed(begin + offset, synapseId) ? GetSynapticStrength(begin + offset, synapseId) : 0;
+        }
+
         // Expansion mapping
         virtual void AddExpansion(const string& engine, unsigned long int start, unsigned long int length) = 0;
         virtual const ModelMapper& GetExpansionMap() const = 0;
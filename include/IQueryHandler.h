@@ -2,15 +2,32 @@
 
 #include <string>
 
+#include "nlohmann/json.hpp"
+
 namespace embeddedpenguins::core::neuron::model
 {
     using std::string;
 
+    using nlohmann::json;
+
     class IQueryHandler
     {
     public:
         virtual ~IQueryHandler() = default;
 
         virtual const string& HandleQuery(const string& query) = 0;
+
+        //
+        // The status element of a fullstatus response.  Handlers that can
+        // build it directly should override this to skip the query round trip.
+        //
+        virtual json RenderStatus()
+        {
+            auto response = json::parse(HandleQuery(R"({"query":"fullstatus"})"), nullptr, false);
+            if (response.is_discarded() || !response.contains("response") || !response["response"].contains("status"))
+                return json::object();
+
+            return response["response"]["status"];
+        }
     };
 }
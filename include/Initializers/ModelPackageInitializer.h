@@ -1,5 +1,6 @@
 #pragma once
 #include <fstream>
+#include <algorithm>
 
 #include "IModelHelper.h"
 #include "ModelNeuronInitializer.h"
@@ -112,7 +113,8 @@ namespace embeddedpenguins::core::neuron::model
                     << (int)connection.SynapticStrength << "," 
                     << (int)connection.Type 
                     << "\n";
-                this->helper_->Wire(connection.PreSynapticNeuron + engineOffset, connection.PostSynapticNeuron + engineOffset, (int)connection.SynapticStrength, ToModelType(connection.Type));
+                auto& expansionMap = this->helper_->GetExpansionMap();
+                this->helper_->Wire(expansionMap.StorageIndex(connection.PreSynapticNeuron + engineOffset), expansionMap.StorageIndex(connection.PostSynapticNeuron + engineOffset), (int)connection.SynapticStrength, ToModelType(connection.Type));
             }
         }
 
@@ -152,6 +154,27 @@ namespace embeddedpenguins::core::neuron::model
                     spikeOutputDescriptors_.push_back(interconnectDescriptor);
                 }
             }
+
+            GroupDescriptorsByHost();
+        }
+
+        //
+        // Outputs to the same host share one connection, each interconnect
+        // a section of every packet sent on it (see SpikeOutputChannel).
+        // Keep each host's descriptors together, so its connection is made
+        // once, by the first of them, and the rest join it.
+        //
+        void GroupDescriptorsByHost()
+        {
+            std::stable_sort(spikeOutputDescriptors_.begin(), spikeOutputDescriptors_.end(),
+                [](const SpikeOutputDescriptor& left, const SpikeOutputDescriptor& right) { return left.Host < right.Host; });
+
+            for (auto first = spikeOutputDescriptors_.begin(); first != spikeOutputDescriptors_.end(); )
+            {
+                auto last = std::find_if(first, spikeOutputDescriptors_.end(), [&first](const SpikeOutputDescriptor& descriptor) { return descriptor.Host != first->Host; });
+                cout << "ModelPackageInitializer " << (last - first) << " interconnects to host '" << first->Host << "' share one connection\n";
+                first = last;
+            }
         }
     };
 }
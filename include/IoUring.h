@@ -0,0 +1,398 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "nlohmann/json.hpp"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::vector;
+    using std::atomic_ref;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+
+    using nlohmann::json;
+
+    //
+    // A minimal io_uring, driven by the raw system calls so no library is needed.
+    // Submission queue entries are prepared with NextSqe(), handed to the
+    // kernel together by one Submit(), and completions are read straight
+    // from the shared completion ring by ReapCompletions().
+    //
+    // Not thread safe; each ring belongs to one thread at a time.
+    //
+    class IoUring
+    {
+        int fd_ { -1 };
+        io_uring_params params_ { };
+
+        void* sqRing_ { nullptr };
+        size_t sqRingSize_ { 0 };
+        void* cqRing_ { nullptr };
+        size_t cqRingSize_ { 0 };
+        io_uring_sqe* sqes_ { nullptr };
+        size_t sqesSize_ { 0 };
+
+        unsigned int* sqHead_ { nullptr };
+        unsigned int* sqTail_ { nullptr };
+        unsigned int sqMask_ { 0 };
+        unsigned int* sqArray_ { nullptr };
+        unsigned int* cqHead_ { nullptr };
+        unsigned int* cqTail_ { nullptr };
+        unsigned int cqMask_ { 0 };
+        io_uring_cqe* cqes_ { nullptr };
+
+        unsigned int localTail_ { 0 };
+        unsigned int submittedTail_ { 0 };
+
+    public:
+        bool Valid() const { return fd_ >= 0; }
+        int Fd() const { return fd_; }
+        unsigned int Pending() const { return localTail_ - submittedTail_; }
+
+    public:
+        IoUring() = default;
+
+        IoUring(const IoUring& other) = delete;
+        IoUring& operator=(const IoUring& other) = delete;
+        IoUring(IoUring&& other) noexcept = delete;
+        IoUring& operator=(IoUring&& other) noexcept = delete;
+
+        ~IoUring()
+        {
+            Close();
+        }
+
+        //
+        // True if this kernel supports everything the spike transports use.
+        //
+        static bool Supported();
+
+        //
+        // True if the control file asks for io_uring with the Boolean
+        // 'IoUring' property of its 'Execution' section, and the kernel supports it.
+        //
+        static bool Configured(const json& control)
+        {
+            if (!control.contains("Execution")) return false;
+            const json& executionJson = control["Execution"];
+
+            if (!executionJson.contains("IoUring")) return false;
+            const json& ioUringJson = executionJson["IoUring"];
+            if (!ioUringJson.is_boolean() || !ioUringJson.get<bool>()) return false;
+
+            if (!Supported())
+            {
+                cout << "IoUring requested, but not supported by this kernel; using sockets directly\n";
+                return false;
+            }
+
+            return true;
+        }
+
+        bool Setup(unsigned int entries)
+        {
+            Close();
+
+            params_ = io_uring_params { };
+            params_.flags = IORING_SETUP_CLAMP;
+            fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params_));
+            if (fd_ < 0) return false;
+
+            sqRingSize_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned int);
+            cqRingSize_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+            if (params_.features & IORING_FEAT_SINGLE_MMAP)
+                sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+            sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+            if (sqRing_ == MAP_FAILED)
+            {
+                sqRing_ = nullptr;
+                Close();
+                return false;
+            }
+
+            if (params_.features & IORING_FEAT_SINGLE_MMAP)
+                cqRing_ = sqRing_;
+            else
+            {
+                cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+                if (cqRing_ == MAP_FAILED)
+                {
+                    cqRing_ = nullptr;
+                    Close();
+                    return false;
+                }
+            }
+
+            sqesSize_ = params_.sq_entries * sizeof(io_uring_sqe);
+            auto* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+            {
+                Close();
+                return false;
+            }
+            sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+            auto* sq = static_cast<char*>(sqRing_);
+            sqHead_ = reinterpret_cast<unsigned int*>(sq + params_.sq_off.head);
+            sqTail_ = reinterpret_cast<unsigned int*>(sq + params_.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned int*>(sq + params_.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned int*>(sq + params_.sq_off.array);
+
+            auto* cq = static_cast<char*>(cqRing_);
+            cqHead_ = reinterpret_cast<unsigned int*>(cq + params_.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned int*>(cq + params_.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned int*>(cq + params_.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+
+            localTail_ = submittedTail_ = *sqTail_;
+            return true;
+        }
+
+        void Close()
+        {
+            if (sqes_) munmap(sqes_, sqesSize_);
+            if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+            if (sqRing_) munmap(sqRing_, sqRingSize_);
+            if (fd_ >= 0) close(fd_);
+
+            sqes_ = nullptr;
+            cqRing_ = nullptr;
+            sqRing_ = nullptr;
+            fd_ = -1;
+        }
+
+        //
+        // The next free submission queue entry, cleared, or null if the queue is full.
+        //
+        io_uring_sqe* NextSqe()
+        {
+            auto head = atomic_ref<unsigned int>(*sqHead_).load(memory_order_acquire);
+            if (localTail_ - head >= params_.sq_entries) return nullptr;
+
+            auto index = localTail_ & sqMask_;
+            auto* sqe = &sqes_[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqArray_[index] = index;
+            localTail_++;
+
+            return sqe;
+        }
+
+        //
+        // Hand every prepared entry to the kernel in one system call, and
+        // optionally wait until at least waitCount completions are available.
+        // Return the number submitted, or negative errno.
+        //
+        int Submit(unsigned int waitCount = 0)
+        {
+            auto toSubmit = Pending();
+            if (toSubmit == 0 && waitCount == 0) return 0;
+
+            atomic_ref<unsigned int>(*sqTail_).store(localTail_, memory_order_release);
+
+            int result;
+            do
+            {
+                result = static_cast<int>(syscall(__NR_io_uring_enter, fd_, toSubmit, waitCount, waitCount > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            } while (result < 0 && errno == EINTR);
+
+            if (result < 0) return -errno;
+
+            submittedTail_ += result;
+            return result;
+        }
+
+        //
+        // Take back the entries prepared since the last submission, which the
+        // kernel has not seen, and return how many there were.  Without a
+        // kernel polling thread, the kernel reads the queue only when entered.
+        //
+        unsigned int DiscardPending()
+        {
+            auto discarded = Pending();
+            localTail_ = submittedTail_;
+            atomic_ref<unsigned int>(*sqTail_).store(localTail_, memory_order_release);
+            return discarded;
+        }
+
+        //
+        // Hand every available completion to the visitor, as visitor(const io_uring_cqe&),
+        // and return the number handled.
+        //
+        template<class VISITOR>
+        unsigned int ReapCompletions(VISITOR&& visitor)
+        {
+            auto head = *cqHead_;
+            auto tail = atomic_ref<unsigned int>(*cqTail_).load(memory_order_acquire);
+
+            unsigned int count { 0 };
+            for (; head != tail; head++, count++)
+                visitor(cqes_[head & cqMask_]);
+
+            atomic_ref<unsigned int>(*cqHead_).store(head, memory_order_release);
+            return count;
+        }
+
+        //
+        // Signal the eventfd whenever a completion is posted, so the ring can
+        // be waited on with every other descriptor.
+        //
+        bool RegisterEventFd(int eventFd)
+        {
+            return Register(IORING_REGISTER_EVENTFD, &eventFd, 1) >= 0;
+        }
+
+        int Register(unsigned int opcode, void* argument, unsigned int count)
+        {
+            auto result = static_cast<int>(syscall(__NR_io_uring_register, fd_, opcode, argument, count));
+            return result < 0 ? -errno : result;
+        }
+    };
+
+    //
+    // A ring of equally sized buffers provided to the kernel for receives
+    // that select their own buffer, such as multishot receives.  The kernel
+    // takes a buffer per completion, reported by its id in the completion
+    // flags; the owner hands it back with Recycle() once the data is consumed,
+    // and publishes every recycled buffer at once with Publish().
+    //
+    // The ring is addressed as a plain array of io_uring_buf, whose first
+    // entry's reserved field is the ring tail: io_uring_buf_ring declares
+    // the same with a flexible array that C++ compilers lay out differently.
+    //
+    class IoUringBufferRing
+    {
+        io_uring_buf* ring_ { nullptr };
+        size_t ringSize_ { 0 };
+        vector<char> storage_ { };
+        unsigned int count_ { 0 };
+        unsigned int bufferSize_ { 0 };
+        unsigned short group_ { 0 };
+        unsigned short localTail_ { 0 };
+
+    public:
+        bool Valid() const { return ring_ != nullptr; }
+        unsigned short Group() const { return group_; }
+
+    public:
+        IoUringBufferRing() = default;
+
+        IoUringBufferRing(const IoUringBufferRing& other) = delete;
+        IoUringBufferRing& operator=(const IoUringBufferRing& other) = delete;
+        IoUringBufferRing(IoUringBufferRing&& other) noexcept = delete;
+        IoUringBufferRing& operator=(IoUringBufferRing&& other) noexcept = delete;
+
+        ~IoUringBufferRing()
+        {
+            if (ring_) munmap(ring_, ringSize_);
+        }
+
+        //
+        // Register count buffers (a power of two) of bufferSize bytes as buffer group 'group'.
+        //
+        bool Setup(IoUring& uring, unsigned short group, unsigned int count, unsigned int bufferSize)
+        {
+            ringSize_ = count * sizeof(io_uring_buf);
+            auto* ring = mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ring == MAP_FAILED) return false;
+
+            io_uring_buf_reg registration { };
+            registration.ring_addr = reinterpret_cast<unsigned long long>(ring);
+            registration.ring_entries = count;
+            registration.bgid = group;
+            auto result = uring.Register(IORING_REGISTER_PBUF_RING, &registration, 1);
+            if (result < 0)
+            {
+                cout << "IoUringBufferRing unable to register buffers: " << std::strerror(-result) << "\n";
+                munmap(ring, ringSize_);
+                return false;
+            }
+
+            ring_ = static_cast<io_uring_buf*>(ring);
+            storage_.resize(static_cast<size_t>(count) * bufferSize);
+            count_ = count;
+            bufferSize_ = bufferSize;
+            group_ = group;
+
+            for (unsigned int id = 0; id < count_; id++)
+                Recycle(id);
+            Publish();
+
+            return true;
+        }
+
+        char* Buffer(unsigned int id) { return storage_.data() + static_cast<size_t>(id) * bufferSize_; }
+
+        void Recycle(unsigned int id)
+        {
+            auto& buffer = ring_[localTail_ & (count_ - 1)];
+            buffer.addr = reinterpret_cast<unsigned long long>(Buffer(id));
+            buffer.len = bufferSize_;
+            buffer.bid = static_cast<unsigned short>(id);
+            localTail_++;
+        }
+
+        void Publish()
+        {
+            atomic_ref<unsigned short>(ring_[0].resv).store(localTail_, memory_order_release);
+        }
+    };
+
+    //
+    // Multishot receives and provided buffer rings have no feature flag of
+    // their own, so try one: a multishot receive on a socket pair should
+    // complete with the data and stay armed.  Checked once per process.
+    //
+    inline bool IoUring::Supported()
+    {
+        static const bool supported = []() {
+            IoUring ring;
+            if (!ring.Setup(4)) return false;
+
+            IoUringBufferRing buffers;
+            if (!buffers.Setup(ring, 0, 2, 64)) return false;
+
+            int sockets[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0) return false;
+
+            bool armed { false };
+            auto* sqe = ring.NextSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = sockets[0];
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = buffers.Group();
+
+            char probe { 'p' };
+            if (write(sockets[1], &probe, 1) == 1 && ring.Submit(1) == 1)
+            {
+                ring.ReapCompletions([&armed](const io_uring_cqe& cqe) {
+                    armed = armed || (cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE) != 0);
+                });
+            }
+
+            close(sockets[1]);
+            close(sockets[0]);
+            ring.Close();
+
+            return armed;
+        }();
+
+        return supported;
+    }
+}
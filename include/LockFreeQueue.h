@@ -0,0 +1,108 @@
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::unique_ptr;
+    using std::atomic;
+    using std::size_t;
+    using std::memory_order_relaxed;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+
+    //
+    // A bounded, lock-free queue for exactly one producer thread and
+    // exactly one consumer thread.  The capacity is rounded up to a power
+    // of two so that indexes wrap with a mask rather than a divide.
+    // Head and tail live on separate cache lines so that the producer
+    // and consumer do not contend for the same line.
+    //
+    // NOTE Pushing to a full queue fails rather than blocks.  It is up
+    //      to the producer to decide what to do with the overflow.
+    //
+    template<class ELEMENTTYPE>
+    class LockFreeQueue
+    {
+        static constexpr size_t CacheLineSize { 64 };
+
+        const size_t capacity_;
+        const size_t mask_;
+        unique_ptr<ELEMENTTYPE[]> elements_;
+
+        alignas(CacheLineSize) atomic<size_t> head_ { 0 };     // Next element to pop, written only by the consumer.
+        alignas(CacheLineSize) atomic<size_t> tail_ { 0 };     // Next element to push, written only by the producer.
+
+    public:
+        LockFreeQueue(size_t capacity) :
+            capacity_(RoundUpToPowerOfTwo(capacity)),
+            mask_(capacity_ - 1),
+            elements_(new ELEMENTTYPE[capacity_])
+        {
+        }
+
+        LockFreeQueue(const LockFreeQueue& other) = delete;
+        LockFreeQueue& operator=(const LockFreeQueue& other) = delete;
+        LockFreeQueue(LockFreeQueue&& other) noexcept = delete;
+        LockFreeQueue& operator=(LockFreeQueue&& other) noexcept = delete;
+
+        size_t Capacity() const { return capacity_; }
+        bool Empty() const { return head_.load(memory_order_acquire) == tail_.load(memory_order_acquire); }
+
+        //
+        // Producer thread only.  Return false without pushing if the queue is full.
+        //
+        bool TryPush(const ELEMENTTYPE& element)
+        {
+            auto tail = tail_.load(memory_order_relaxed);
+            if (tail - head_.load(memory_order_acquire) == capacity_)
+                return false;
+
+            elements_[tail & mask_] = element;
+            tail_.store(tail + 1, memory_order_release);
+            return true;
+        }
+
+        //
+        // Consumer thread only.  Return false if the queue is empty.
+        //
+        bool TryPop(ELEMENTTYPE& element)
+        {
+            auto head = head_.load(memory_order_relaxed);
+            if (head == tail_.load(memory_order_acquire))
+                return false;
+
+            element = elements_[head & mask_];
+            head_.store(head + 1, memory_order_release);
+            return true;
+        }
+
+        //
+        // Consumer thread only.  Hand every element currently in the queue
+        // to the visitor, then release them all to the producer at once.
+        // Return the number of elements drained.
+        //
+        template<class VISITOR>
+        size_t Drain(VISITOR&& visitor)
+        {
+            auto head = head_.load(memory_order_relaxed);
+            auto tail = tail_.load(memory_order_acquire);
+
+            for (auto index = head; index != tail; index++)
+                visitor(elements_[index & mask_]);
+
+            head_.store(tail, memory_order_release);
+            return tail - head;
+        }
+
+    private:
+        static size_t RoundUpToPowerOfTwo(size_t value)
+        {
+            size_t rounded { 1 };
+            while (rounded < value) rounded <<= 1;
+            return rounded;
+        }
+    };
+}
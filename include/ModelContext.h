@@ -14,6 +14,9 @@
 #include "ConfigurationRepository.h"
 #include "Log.h"
 #include "Performance.h"
+#include "TickProfiler.h"
+#include "HardwareCounters.h"
+#include "ThreadPlacement.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
@@ -24,25 +27,86 @@ namespace embeddedpenguins::core::neuron::model
     using std::condition_variable;
     using std::vector;
     using std::unique_ptr;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::memory_order_relaxed;
     using std::chrono::microseconds;
     using std::chrono::_V2::system_clock;
     using std::chrono::high_resolution_clock;
 
     using nlohmann::json;
+
+    class SpikeSendBatch;
     
     //
     // During a run, capture the measurements and statistics about that
     // run here.  This struct can then be copied out to a permanent location
     // before its containing context is deleted.
     //
+    // The engine thread is the only writer of the iteration and work counters,
+    // but inputs, outputs and status read them from other threads, so they
+    // are atomic.  The engine should update them with AdvanceIteration() and
+    // AddWork(), whose relaxed load and store cost no more than a plain
+    // increment; the increment operators also work, but as locked read-modify-writes.
+    //
     struct RunMeasurements
     {
         microseconds PartitionTime { };
         system_clock::time_point EngineStartTime { };
         system_clock::time_point EngineStopTime { };
-        unsigned long long int Iterations { 1LL };
-        long long int TotalWork { 0LL };
+        atomic<unsigned long long int> Iterations { 1LL };
+        atomic<long long int> TotalWork { 0LL };
+        // Spike packets outputs could not deliver:  a shared ring stayed full, or no receiver was reachable.
+        atomic<unsigned long long int> SpikePacketsDropped { 0ULL };
         Performance PerformanceCounters { };
+        TickProfiler Profile { };
+        HardwareCounters Counters { };
+
+        RunMeasurements() = default;
+
+        RunMeasurements(const RunMeasurements& other) :
+            PartitionTime(other.PartitionTime),
+            EngineStartTime(other.EngineStartTime),
+            EngineStopTime(other.EngineStopTime),
+            Iterations(other.Iterations.load(memory_order_relaxed)),
+            TotalWork(other.TotalWork.load(memory_order_relaxed)),
+            SpikePacketsDropped(other.SpikePacketsDropped.load(memory_order_relaxed)),
+            PerformanceCounters(other.PerformanceCounters),
+            Profile(other.Profile),
+            Counters(other.Counters)
+        {
+        }
+
+        RunMeasurements& operator=(const RunMeasurements& other)
+        {
+            if (this != &other)
+            {
+                PartitionTime = other.PartitionTime;
+                EngineStartTime = other.EngineStartTime;
+                EngineStopTime = other.EngineStopTime;
+                Iterations.store(other.Iterations.load(memory_order_relaxed), memory_order_relaxed);
+                TotalWork.store(other.TotalWork.load(memory_order_relaxed), memory_order_relaxed);
+                SpikePacketsDropped.store(other.SpikePacketsDropped.load(memory_order_relaxed), memory_order_relaxed);
+                PerformanceCounters = other.PerformanceCounters;
+                Profile = other.Profile;
+                Counters = other.Counters;
+            }
+
+            return *this;
+        }
+
+        //
+        // Engine thread only.
+        //
+        void AdvanceIteration()
+        {
+            Iterations.store(Iterations.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        }
+
+        void AddWork(long long int work)
+        {
+            TotalWork.store(TotalWork.load(memory_order_relaxed) + work, memory_order_relaxed);
+        }
     };
 
     //
@@ -70,12 +134,24 @@ namespace embeddedpenguins::core::neuron::model
         atomic<bool> EngineInitialized { false };
         atomic<bool> EngineInitializeFailed { false };
         RunMeasurements& Measurements;
+        // The engine's batch of spike socket sends, while one is active (see SpikeSendBatch).
+        atomic<SpikeSendBatch*> SendBatch { nullptr };
 
         ModelContext(ConfigurationRepository& configuration, RunMeasurements& runMeasurements) :
             Configuration(configuration),
             EnginePeriod(1000),
             Measurements(runMeasurements)
         {
+            TickProfiler::Active() = &Measurements.Profile;
+            HardwareCounters::Active() = &Measurements.Counters;
+        }
+
+        ~ModelContext()
+        {
+            auto* profile = &Measurements.Profile;
+            TickProfiler::Active().compare_exchange_strong(profile, nullptr);
+            auto* counters = &Measurements.Counters;
+            HardwareCounters::Active().compare_exchange_strong(counters, nullptr);
         }
 
         //
@@ -85,18 +161,57 @@ namespace embeddedpenguins::core::neuron::model
         bool Initialize()
         {
             LogFile = Configuration.ComposeRecordPathForModel(Configuration.ExtractRecordDirectory(), LogFile);
+            Measurements.PerformanceCounters.TrackThreads(&Configuration.Threads());
             cout << "Context initialized with ticks = " << EnginePeriod.count() << " us\n";
+            InvalidateStaticStatus();
 
             return true;
         }
 
+        //
+        // Call from the engine thread to apply the 'Engine' thread placement, if configured.
+        //
+        bool PlaceEngineThread()
+        {
+            auto placement = ThreadPlacement::FromConfiguration(*Configuration.Control(), "Engine");
+            placement.Registry = &Configuration.Threads();
+            return placement.Apply();
+        }
+
+        //
+        // Call from the engine thread to count hardware events on it, if enabled
+        // by the 'HardwareCounters' element of the control file 'Execution' section:
+        //
+        //  "HardwareCounters": { "Enable": true, "SampleTicks": 1000 }
+        //
+        bool OpenHardwareCounters()
+        {
+            auto controlSnapshot = Configuration.Control();
+            const json& control = *controlSnapshot;
+            if (!control.contains("Execution")) return false;
+            const json& executionJson = control["Execution"];
+
+            if (!executionJson.contains("HardwareCounters")) return false;
+            const json& countersJson = executionJson["HardwareCounters"];
+            if (!countersJson.is_object()) return false;
+
+            if (!countersJson.contains("Enable") || !countersJson["Enable"].is_boolean() || !countersJson["Enable"].get<bool>())
+                return false;
+
+            unsigned int sampleTicks { 1'000 };
+            if (countersJson.contains("SampleTicks") && countersJson["SampleTicks"].is_number_unsigned())
+                sampleTicks = countersJson["SampleTicks"].get<unsigned int>();
+
+            return Measurements.Counters.Open(sampleTicks);
+        }
+
         //
         //  Capture now as the start time.
         //
         void TriggerStartTime()
         {
             Measurements.EngineStartTime = high_resolution_clock::now();
-            Measurements.Iterations = 0LL;
+            Measurements.Iterations.store(0LL, memory_order_relaxed);
         }
 
         //
@@ -109,24 +224,16 @@ namespace embeddedpenguins::core::neuron::model
 
         //
         // Render all the context properties as a single JSON object.
+        // The static properties are cached until changed by SetValue()
+        // or a configuration change, so only the dynamic ones cost anything.
         //
         json Render()
         {
-            return json {
-                {"run", Run ? true : false},
-                {"pause", Pause ? true : false},
-                {"loglevel", LoggingLevel},
-                {"logfile", LogFile.c_str()},
-                {"recordfile", Configuration.ComposeRecordPath().c_str()},
-                {"recordenable", RecordEnable ? true : false},
-                {"recordsynapses", RecordSynapseEnable ? true : false},
-                {"engineperiod", EnginePeriod.count()},
-                {"engineinit", EngineInitialized ? true : false},
-                {"enginefail", EngineInitializeFailed ? true : false},
-                {"iterations", Measurements.Iterations},
-                {"totalwork", Measurements.TotalWork},
-                {"cpu", Measurements.PerformanceCounters.GetActiveTotalCpu()}
-            };
+            json status = CachedStaticStatus()->Status;
+            RenderDynamicInto(status);
+            status["placement"] = Configuration.Threads().Render();
+
+            return status;
         }
 
         //
@@ -134,15 +241,10 @@ namespace embeddedpenguins::core::neuron::model
         //
         json RenderDynamic()
         {
-            return json {
-                {"run", Run ? true : false},
-                {"pause", Pause ? true : false},
-                {"engineinit", EngineInitialized ? true : false},
-                {"enginefail", EngineInitializeFailed ? true : false},
-                {"iterations", Measurements.Iterations},
-                {"totalwork", Measurements.TotalWork},
-                {"cpu", Measurements.PerformanceCounters.GetActiveTotalCpu()}
-            };
+            json status = json::object();
+            RenderDynamicInto(status);
+
+            return status;
         }
 
         //
@@ -194,8 +296,63 @@ namespace embeddedpenguins::core::neuron::model
             {
                 success = false;
             }
-            
+
+            InvalidateStaticStatus();
             return success;
         }
+
+    private:
+        struct StaticStatus
+        {
+            unsigned long long int Generation {};
+            json Status {};
+        };
+
+        atomic<shared_ptr<const StaticStatus>> staticStatus_ { };
+
+        void InvalidateStaticStatus()
+        {
+            staticStatus_.store(shared_ptr<const StaticStatus>());
+        }
+
+        shared_ptr<const StaticStatus> CachedStaticStatus()
+        {
+            auto runtime = Configuration.Runtime();
+            auto staticStatus = staticStatus_.load();
+            if (staticStatus && staticStatus->Generation == runtime->Generation)
+                return staticStatus;
+
+            auto rendered = make_shared<StaticStatus>();
+            rendered->Generation = runtime->Generation;
+            rendered->Status = json {
+                {"loglevel", LoggingLevel},
+                {"logfile", LogFile.c_str()},
+                {"recordfile", runtime->RecordPath},
+                {"recordenable", RecordEnable ? true : false},
+                {"recordsynapses", RecordSynapseEnable ? true : false},
+                {"engineperiod", EnginePeriod.count()}
+            };
+
+            staticStatus = rendered;
+            staticStatus_ = staticStatus;
+            return staticStatus;
+        }
+
+        //
+        // The counters are relaxed atomics, so a value is never torn,
+        // though it may be a tick behind.
+        //
+        void RenderDynamicInto(json& status)
+        {
+            status["run"] = Run ? true : false;
+            status["pause"] = Pause ? true : false;
+            status["engineinit"] = EngineInitialized ? true : false;
+            status["enginefail"] = EngineInitializeFailed ? true : false;
+            status["iterations"] = Measurements.Iterations.load(memory_order_relaxed);
+            status["totalwork"] = Measurements.TotalWork.load(memory_order_relaxed);
+            status["spikepacketsdropped"] = Measurements.SpikePacketsDropped.load(memory_order_relaxed);
+            status["cpu"] = Measurements.PerformanceCounters.GetActiveTotalCpu();
+            status["performance"] = Measurements.PerformanceCounters.Render();
+        }
     };
 }
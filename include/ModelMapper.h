@@ -14,78 +14,252 @@ namespace embeddedpenguins::core::neuron::model
     using std::string;
 
     //
-    // The global model allows for splitting along expansion lines, 
+    // The global model allows for splitting along expansion lines,
     // where each expansion may be deployed to a different
     // engine.  So for each engine, the expansions not deployed
     // on that engine are compressed to empty expansions.
-    // This class provides a mapping between the global index 
+    // This class provides a mapping between the global index
     // of a model neuron and its local storage, taking into account
     // the empty expansions.
     //
+    // The mapping is kept flat:
+    // * A prefix-offset array gives the local start of every
+    //   expansion, and a parallel array its end.  The end of each is the
+    //   start of the next, unless the next was added starting further on.
+    // * Reverse, a compact index holds the first expansion ending after the
+    //   first neuron of each block of local neurons, so finding the expansion
+    //   of a local index is one load plus a short step past small expansions.
+    //   The output router uses this to route collected records by expansion.
+    // * Optionally, a carrier that stores neurons in a different order
+    //   sets a permutation from local index to storage index.  Without one,
+    //   the storage index is the local index.
+    //
     class ModelMapper
     {
+        static constexpr unsigned int ReverseIndexBlockShift { 10 };
+
         //
-        // Capture enough information about an expansion to allow
-        // forward mapping from global model indexes to local indexes,
-        // taking into account the empty expansions.
-        struct ExpansionMap
-        {
-            //
-            // Host name of the engine assigned this
-            // expansion.  Suitable for a socket connection.
-            string ExpansionEngine {};
-            //
-            // Starting index within the local model
-            // of the first neuron in this expansion.
-            // Note this may be different from the global
-            // model index, due to skipping expansions
-            // not deployed to this engine.
-            unsigned long int ExpansionStart {};
-
-            //
-            // Ending index + 1 within the local model
-            // of the last neuron in this expansion.
-            // ExpansionOffset == ExpansionOffset for an empty expansion.
-            unsigned long int ExpansionEnd {};
-        };
-
-        //
-        // All model expansions mapped into this engine.
-        vector<ExpansionMap> expansionMap_ {};
+        // Starting index within the local model of each expansion
+        // mapped into this engine, plus one final entry for the end
+        // of the last.  Note this may be different from the global
+        // model index, due to skipping expansions not deployed to
+        // this engine, which are empty here.
+        vector<unsigned long int> expansionOffsets_ { 0 };
+
+        //
+        // Ending index + 1 within the local model of each expansion.
+        vector<unsigned long int> expansionEnds_ {};
+
+        //
+        // Host name of the engine assigned each
+        // expansion.  Suitable for a socket connection.
+        vector<string> expansionEngines_ {};
+
+        //
+        // The first expansion ending after the first local neuron of each block.
+        vector<unsigned short int> reverseIndex_ {};
+
+        //
+        // Local index to storage index, and back; empty if they are the same.
+        vector<unsigned long int> storageIndexes_ {};
+        vector<unsigned long int> localIndexes_ {};
+
+        const string nullEngine_ {};
 
     public:
-        void Reset() { expansionMap_.clear(); }
-        
-        void AddExpansion(const string& engine, unsigned long int start, unsigned long int length)
+        void Reset()
+        {
+            expansionOffsets_.assign(1, 0);
+            expansionEnds_.clear();
+            expansionEngines_.clear();
+            reverseIndex_.clear();
+            storageIndexes_.clear();
+            localIndexes_.clear();
+        }
+
+        unsigned short int ExpansionCount() const { return static_cast<unsigned short int>(expansionEngines_.size()); }
+        unsigned long int LocalSize() const { return expansionOffsets_.back(); }
+        bool Permuted() const { return !storageIndexes_.empty(); }
+
+        //
+        // Expansions must be added in order.  One may start after the previous
+        // one ends, leaving the local indexes between them in no expansion,
+        // but an entry starting before the previous end is rejected.
+        //
+        bool AddExpansion(const string& engine, unsigned long int start, unsigned long int length)
         {
             cout << "Adding expansion map entry for engine " << engine << ": starting at " << start << " for length " << length << "\n";
-            expansionMap_.push_back(ExpansionMap{.ExpansionEngine=engine, .ExpansionStart=start, .ExpansionEnd=start+length});
+            if (start < expansionOffsets_.back())
+            {
+                cout << "Expansion map entry for engine " << engine << " starts at " << start << ", before the end of the previous expansion " << expansionOffsets_.back() << "; rejected\n";
+                return false;
+            }
+
+            auto expansionId = static_cast<unsigned short int>(expansionEngines_.size());
+            auto end = start + length;
+            expansionEngines_.push_back(engine);
+            expansionOffsets_.back() = start;
+            expansionOffsets_.push_back(end);
+            expansionEnds_.push_back(end);
+
+            while ((static_cast<unsigned long int>(reverseIndex_.size()) << ReverseIndexBlockShift) < end)
+                reverseIndex_.push_back(expansionId);
+            return true;
         }
 
         unsigned long int ExpansionOffset(unsigned short int expansionId) const
         {
-            if (expansionId >= expansionMap_.size())
+            if (expansionId >= expansionEngines_.size())
                 return numeric_limits<unsigned long>::max();
 
-            return expansionMap_[expansionId].ExpansionStart;
+            return expansionOffsets_[expansionId];
         }
 
         unsigned long int ExpansionEnd(unsigned short int expansionId) const
         {
-            if (expansionId >= expansionMap_.size())
+            if (expansionId >= expansionEngines_.size())
                 return numeric_limits<unsigned long>::max();
 
-            return expansionMap_[expansionId].ExpansionEnd;
+            return expansionEnds_[expansionId];
         }
 
         const string& ExpansionEngine(unsigned short int expansionId) const
         {
-            static string nullEngine {};
+            if (expansionId >= expansionEngines_.size())
+                return nullEngine_;
+
+            return expansionEngines_[expansionId];
+        }
+
+        //
+        // Reverse mapping: the expansion holding a local index, and the offset within it.
+        // Returns false if the index is beyond the local model, or between expansions.
+        //
+        bool FindExpansion(unsigned long int localIndex, unsigned short int& expansionId, unsigned long int& offset) const
+        {
+            if (localIndex >= LocalSize())
+                return false;
+
+            auto id = reverseIndex_[localIndex >> ReverseIndexBlockShift];
+            while (expansionEnds_[id] <= localIndex)
+                id++;
+
+            if (localIndex < expansionOffsets_[id])
+                return false;
 
-            if (expansionId >= expansionMap_.size())
-                return nullEngine;
+            expansionId = id;
+            offset = localIndex - expansionOffsets_[id];
+            return true;
+        }
+
+        //
+        // Set the storage order of local neurons: storageIndexes[localIndex] is
+        // where the carrier keeps that neuron.  Must cover the whole local model,
+        // once each, and be set before the model is wired.  An empty vector
+        // restores the identity.
+        //
+        bool SetStoragePermutation(const vector<unsigned long int>& storageIndexes)
+        {
+            if (storageIndexes.empty())
+            {
+                storageIndexes_.clear();
+                localIndexes_.clear();
+                return true;
+            }
+
+            vector<unsigned long int> localIndexes(storageIndexes.size(), numeric_limits<unsigned long>::max());
+            for (unsigned long int localIndex = 0; localIndex < storageIndexes.size(); localIndex++)
+            {
+                auto storageIndex = storageIndexes[localIndex];
+                if (storageIndexes.size() != LocalSize() || storageIndex >= storageIndexes.size() || localIndexes[storageIndex] != numeric_limits<unsigned long>::max())
+                {
+                    cout << "Storage permutation is not a permutation of the " << LocalSize() << " local neurons; ignored\n";
+                    return false;
+                }
+
+                localIndexes[storageIndex] = localIndex;
+            }
+
+            storageIndexes_ = storageIndexes;
+            localIndexes_ = std::move(localIndexes);
+            return true;
+        }
+
+        unsigned long int StorageIndex(unsigned long int localIndex) const
+        {
+            return localIndex < storageIndexes_.size() ? storageIndexes_[localIndex] : localIndex;
+        }
+
+        unsigned long int LocalIndex(unsigned long int storageIndex) const
+        {
+            return storageIndex < localIndexes_.size() ? localIndexes_[storageIndex] : storageIndex;
+        }
+
+        //
+        // Batch forward translation of a whole spike array received for one
+        // layer, whose first neuron is at the local index layerBase.  Calls
+        // sink(spike, storageIndex) for each spike within the local model,
+        // and returns the number dropped for falling outside it.
+        //
+        template<class SPIKE, class SINK>
+        unsigned int TranslateToStorage(unsigned long int layerBase, const SPIKE* spikes, unsigned int count, SINK&& sink) const
+        {
+            unsigned int dropped { 0 };
+            auto localSize = LocalSize();
+
+            if (storageIndexes_.empty())
+            {
+                for (unsigned int index = 0; index < count; index++)
+                {
+                    auto localIndex = layerBase + spikes[index].NeuronIndex;
+                    if (localIndex < localSize) sink(spikes[index], localIndex); else dropped++;
+                }
+            }
+            else
+            {
+                for (unsigned int index = 0; index < count; index++)
+                {
+                    auto localIndex = layerBase + spikes[index].NeuronIndex;
+                    if (localIndex < localSize) sink(spikes[index], storageIndexes_[localIndex]); else dropped++;
+                }
+            }
+
+            return dropped;
+        }
+
+        //
+        // Batch reverse translation of storage indexes, such as the records
+        // collected in a tick, for output routing.  Calls
+        // sink(position, expansionId, offset) for each index within an expansion.
+        //
+        template<class INDEX, class SINK>
+        void TranslateToExpansions(const INDEX* storageIndexes, size_t count, SINK&& sink) const
+        {
+            unsigned short int expansionId { 0 };
+            unsigned long int offset { 0 };
+
+            for (size_t position = 0; position < count; position++)
+            {
+                if (FindExpansion(LocalIndex(storageIndexes[position]), expansionId, offset))
+                    sink(position, expansionId, offset);
+            }
+        }
+
+        //
+        // The local offset of a layer addressed by a received spike packet,
+        // or max if the layer is not within an expansion deployed to this engine.
+        // The prefix-offset array makes this a bounded lookup, with no table per layer.
+        //
+        unsigned long int InputOffset(unsigned int population, unsigned int layerOffset) const
+        {
+            if (population >= expansionEngines_.size())
+                return numeric_limits<unsigned long>::max();
+
+            auto start = expansionOffsets_[population];
+            if (start + layerOffset >= expansionEnds_[population])
+                return numeric_limits<unsigned long>::max();
 
-            return expansionMap_[expansionId].ExpansionEngine;
+            return start + layerOffset;
         }
     };
 }
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "NeuronRecordCommon.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::vector;
+
+    //
+    // The neuron records collected in one tick, held as a structure of arrays:
+    // element i of each array together make up record i.
+    // The buffer is owned by the caller and reused from tick to tick;
+    // Clear() keeps the capacity, so steady-state collection does not allocate.
+    // Consumers that only need some fields (a spike stream needs only the
+    // neuron index and type) walk only those arrays.
+    // Tick is the tick the records were collected for, set by the collector;
+    // outputs may see them later, so they use it rather than the current tick.
+    //
+    struct NeuronRecordBuffer
+    {
+        unsigned long long int Tick { 0 };
+        vector<unsigned long long> NeuronIndexes {};
+        vector<short int> Activations {};
+        vector<short int> HyperSensitives {};
+        vector<unsigned short> SynapseIndexes {};
+        vector<short int> SynapseStrengths {};
+        vector<NeuronRecordType> Types {};
+
+        size_t Size() const { return NeuronIndexes.size(); }
+        bool Empty() const { return NeuronIndexes.empty(); }
+
+        void Clear()
+        {
+            NeuronIndexes.clear();
+            Activations.clear();
+            HyperSensitives.clear();
+            SynapseIndexes.clear();
+            SynapseStrengths.clear();
+            Types.clear();
+        }
+
+        //
+        // Keep only the first 'size' records.
+        //
+        void Truncate(size_t size)
+        {
+            NeuronIndexes.resize(size);
+            Activations.resize(size);
+            HyperSensitives.resize(size);
+            SynapseIndexes.resize(size);
+            SynapseStrengths.resize(size);
+            Types.resize(size);
+        }
+
+        void Reserve(size_t capacity)
+        {
+            NeuronIndexes.reserve(capacity);
+            Activations.reserve(capacity);
+            HyperSensitives.reserve(capacity);
+            SynapseIndexes.reserve(capacity);
+            SynapseStrengths.reserve(capacity);
+            Types.reserve(capacity);
+        }
+
+        void Add(unsigned long long neuronIndex, short int activation, short int hypersensitive, unsigned short synapseIndex, short int synapseStrength, NeuronRecordType type)
+        {
+            NeuronIndexes.push_back(neuronIndex);
+            Activations.push_back(activation);
+            HyperSensitives.push_back(hypersensitive);
+            SynapseIndexes.push_back(synapseIndex);
+            SynapseStrengths.push_back(synapseStrength);
+            Types.push_back(type);
+        }
+
+        //
+        // Call visitor(neuronIndex, activation, hypersensitive, synapseIndex, synapseStrength, type)
+        // for each record, in order.
+        //
+        template<class VISITOR>
+        void ForEach(VISITOR&& visitor) const
+        {
+            for (size_t record = 0; record < Size(); record++)
+                visitor(NeuronIndexes[record], Activations[record], HyperSensitives[record], SynapseIndexes[record], SynapseStrengths[record], Types[record]);
+        }
+    };
+}
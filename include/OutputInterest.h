@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+
+#include "NeuronRecordCommon.h"
+#include "NeuronRecordBuffer.h"
+#include "ModelMapper.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::vector;
+    using std::pair;
+
+    constexpr unsigned int RecordTypeBit(NeuronRecordType type)
+    {
+        return 1U << static_cast<unsigned int>(type);
+    }
+
+    //
+    // What a spike output consumes: which record types, from which neurons,
+    // on which ticks, and which optional fields.  The engine collects only
+    // records that some output is interested in, so records nobody consumes
+    // are never produced.
+    //
+    // An interest in no record types is empty; no neuron ranges means every neuron.
+    // Neuron ranges are of local model indexes, as outputs are configured,
+    // while records carry storage indexes; Filter() translates between them.
+    // Merging is a union, so a merged interest may admit records a particular
+    // output does not want, and each output still filters its own stream.
+    //
+    struct OutputInterest
+    {
+        unsigned int Types { 0 };
+        vector<pair<unsigned long long int, unsigned long long int>> Ranges {};
+        unsigned int SampleTicks { 1 };
+        bool Synapses { false };
+        bool Activation { false };
+        bool Hypersensitive { false };
+
+        static constexpr unsigned int AllTypes
+        {
+            RecordTypeBit(NeuronRecordType::InputSignal) |
+            RecordTypeBit(NeuronRecordType::Decay) |
+            RecordTypeBit(NeuronRecordType::Spike) |
+            RecordTypeBit(NeuronRecordType::Refractory) |
+            RecordTypeBit(NeuronRecordType::SynapseAdjust) |
+            RecordTypeBit(NeuronRecordType::HyperSensitive)
+        };
+
+        //
+        // Interest in every record and field, on every tick.
+        //
+        static OutputInterest Everything()
+        {
+            return OutputInterest { .Types = AllTypes, .Synapses = true, .Activation = true, .Hypersensitive = true };
+        }
+
+        bool Empty() const { return Types == 0; }
+
+        bool WantsType(NeuronRecordType type) const
+        {
+            return (Types & RecordTypeBit(type)) != 0;
+        }
+
+        bool WantsNeuron(unsigned long long int neuronIndex) const
+        {
+            if (Ranges.empty()) return true;
+
+            for (auto& [begin, end] : Ranges)
+                if (neuronIndex >= begin && neuronIndex < end)
+                    return true;
+
+            return false;
+        }
+
+        bool WantsTick(unsigned long long int tick) const
+        {
+            return SampleTicks <= 1 || tick % SampleTicks == 0;
+        }
+
+        bool Wants(unsigned long long int neuronIndex, NeuronRecordType type) const
+        {
+            return WantsType(type) && WantsNeuron(neuronIndex);
+        }
+
+        //
+        // Widen this interest to also cover another.  Ticks sampled by either
+        // are covered by sampling at the greatest common divisor of the two rates,
+        // so a merged rate is only a lower bound on what each output samples;
+        // spike output proxies drop the ticks their own output does not sample.
+        //
+        void Merge(const OutputInterest& other)
+        {
+            if (other.Empty()) return;
+
+            if (Empty())
+            {
+                *this = other;
+                return;
+            }
+
+            if (Ranges.empty() || other.Ranges.empty())
+                Ranges.clear();
+            else
+            {
+                Ranges.insert(Ranges.end(), other.Ranges.begin(), other.Ranges.end());
+                CoalesceRanges();
+            }
+
+            Types |= other.Types;
+            SampleTicks = std::gcd(SampleTicks > 0 ? SampleTicks : 1, other.SampleTicks > 0 ? other.SampleTicks : 1);
+            Synapses = Synapses || other.Synapses;
+            Activation = Activation || other.Activation;
+            Hypersensitive = Hypersensitive || other.Hypersensitive;
+        }
+
+        //
+        // Drop the records from index 'from' onward that this interest does not want,
+        // compacting the buffer in place.  The expansion map gives the local index
+        // of each record's storage index, to compare with the neuron ranges.
+        //
+        void Filter(NeuronRecordBuffer& records, const ModelMapper& expansionMap, size_t from = 0) const
+        {
+            auto kept = from;
+            for (auto record = from; record < records.Size(); record++)
+            {
+                if (!Wants(expansionMap.LocalIndex(records.NeuronIndexes[record]), records.Types[record])) continue;
+
+                if (kept != record)
+                {
+                    records.NeuronIndexes[kept] = records.NeuronIndexes[record];
+                    records.Activations[kept] = records.Activations[record];
+                    records.HyperSensitives[kept] = records.HyperSensitives[record];
+                    records.SynapseIndexes[kept] = records.SynapseIndexes[record];
+                    records.SynapseStrengths[kept] = records.SynapseStrengths[record];
+                    records.Types[kept] = records.Types[record];
+                }
+                kept++;
+            }
+
+            records.Truncate(kept);
+        }
+
+    private:
+        void CoalesceRanges()
+        {
+            std::sort(Ranges.begin(), Ranges.end());
+
+            size_t last { 0 };
+            for (size_t range = 1; range < Ranges.size(); range++)
+            {
+                if (Ranges[range].first <= Ranges[last].second)
+                    Ranges[last].second = std::max(Ranges[last].second, Ranges[range].second);
+                else
+                    Ranges[++last] = Ranges[range];
+            }
+
+            Ranges.resize(last + 1);
+        }
+    };
+}
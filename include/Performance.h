@@ -3,22 +3,45 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <fstream>
-#include <sstream>
+#include <cstdlib>
 #include <cmath>
 #include <chrono>
 
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "nlohmann/json.hpp"
+
+#include "ThreadPlacement.h"
+
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::string;
     using std::vector;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::atomic;
+    using std::thread;
+    using std::mutex;
+    using std::unique_lock;
+    using std::lock_guard;
+    using std::condition_variable;
     using std::ifstream;
     using std::getline;
-    using std::istringstream;
     using std::chrono::duration;
     using std::chrono::milliseconds;
-    using std::chrono::high_resolution_clock;
+    using std::chrono::nanoseconds;
+    using std::chrono::steady_clock;
+
+    using nlohmann::json;
 
     constexpr int numberOfCounters {10};
     constexpr int user_jiffies       {0};   // time spent in user mode.
@@ -34,6 +57,39 @@ namespace embeddedpenguins::core::neuron::model
 
     constexpr duration minimumPerformanceInterval {milliseconds(1'000)};
 
+    //
+    // One sample of the engine's resource usage, published whole by the sampler.
+    // CPU figures are fractions of one CPU over the last sampling interval.
+    //
+    struct PerformanceSnapshot
+    {
+        struct ThreadCpu
+        {
+            string Name {};
+            pid_t ThreadId { };
+            float Cpu { };
+        };
+
+        vector<float> MachineCpus {};
+        float MachineTotalCpu {};
+        float ProcessCpu {};
+        vector<ThreadCpu> ThreadCpus {};
+        unsigned long long int ResidentBytes {};
+        long MinorFaults {};
+        long MajorFaults {};
+        long VoluntarySwitches {};
+        long InvoluntarySwitches {};
+    };
+
+    //
+    // Sample machine, process and per-thread resource usage on a background
+    // thread once per interval, and publish each sample as an immutable
+    // snapshot.  Readers (status rendering) only load the latest snapshot,
+    // so they never touch procfs or block on the sampler.
+    // Per-thread CPU is reported for every thread in the registry given to TrackThreads().
+    //
+    // A copy is frozen: it holds the source's latest snapshot, and runs no sampler.
+    //
     class Performance
     {
         struct CpuData
@@ -42,113 +98,213 @@ namespace embeddedpenguins::core::neuron::model
             std::size_t times[numberOfCounters];
         };
 
-        vector<CpuData> lastCounters_;
-        high_resolution_clock::time_point lastCountersTime_;
-        vector<float> lastCpuAverage_{};
-        CpuData lastTotalCounters_;
-        high_resolution_clock::time_point lastTotalCountersTime_;
-        float lastTotalCpuAverage_{};
+        struct ThreadTime
+        {
+            pid_t ThreadId {};
+            unsigned long long int RunNanoseconds {};
+        };
+
+        atomic<shared_ptr<const PerformanceSnapshot>> snapshot_ { make_shared<const PerformanceSnapshot>() };
+        atomic<const ThreadRegistry*> threads_ { nullptr };
+
+        // Sampler thread state; not used by a frozen copy.
+        mutex mutex_ {};
+        condition_variable cv_ {};
+        bool quit_ { false };
+        thread samplerThread_ {};
+
+        vector<CpuData> lastCounters_ {};
+        vector<ThreadTime> lastThreadTimes_ {};
+        rusage lastUsage_ {};
+        steady_clock::time_point lastSampleTime_ {};
 
     public:
         Performance()
         {
             ReadCpuCounters(lastCounters_);
-            lastCountersTime_ = high_resolution_clock::now() - minimumPerformanceInterval;
-            ReadCpuTotalCounters(lastTotalCounters_);
-            lastTotalCountersTime_ = high_resolution_clock::now() - minimumPerformanceInterval;
+            getrusage(RUSAGE_SELF, &lastUsage_);
+            lastSampleTime_ = steady_clock::now();
+
+            samplerThread_ = thread([this]() { SamplerLoop(); });
         }
 
-        vector<float> GetActiveCpu()
+        Performance(const Performance& other) :
+            snapshot_(other.snapshot_.load())
         {
-            if (high_resolution_clock::now() - lastCountersTime_ >= minimumPerformanceInterval)
-            {
-                vector<float> averageCpus;
+        }
 
-                vector<CpuData> nextCounters;
-                ReadCpuCounters(nextCounters);
-                if (nextCounters.size() == lastCounters_.size())
-                {
-                    for (auto i = 0; i < nextCounters.size(); i++)
-                    {
-                        auto lastIdleTime = GetIdleTime(lastCounters_[i]);
-                        auto nextIdleTime = GetIdleTime(nextCounters[i]);
-                        auto deltaIdleTime = nextIdleTime - lastIdleTime;
-
-                        auto lastActiveTime = GetActiveTime(lastCounters_[i]);
-                        auto nextActiveTime = GetActiveTime(nextCounters[i]);
-                        auto deltaActiveTime = nextActiveTime - lastActiveTime;
-
-                        averageCpus.push_back((float)deltaActiveTime / (float)(deltaActiveTime + deltaIdleTime));
-                    }
-
-                    lastCounters_ = nextCounters;
-                    lastCpuAverage_ = averageCpus;
-                    lastCountersTime_ = high_resolution_clock::now();
-                }
+        Performance& operator=(const Performance& other)
+        {
+            if (this != &other)
+            {
+                StopSampler();
+                snapshot_ = other.snapshot_.load();
             }
 
-            return lastCpuAverage_;
+            return *this;
         }
 
-        float GetActiveTotalCpu()
+        ~Performance()
         {
-            if (high_resolution_clock::now() - lastTotalCountersTime_ >= minimumPerformanceInterval)
-            {
-                CpuData nextTotalCounters;
-                if (ReadCpuTotalCounters(nextTotalCounters))
-                {
-                    auto lastIdleTime = GetIdleTime(lastTotalCounters_);
-                    auto nextIdleTime = GetIdleTime(nextTotalCounters);
-                    auto deltaIdleTime = nextIdleTime - lastIdleTime;
+            StopSampler();
+        }
 
-                    auto lastActiveTime = GetActiveTime(lastTotalCounters_);
-                    auto nextActiveTime = GetActiveTime(nextTotalCounters);
-                    auto deltaActiveTime = nextActiveTime - lastActiveTime;
+        //
+        // Report per-thread CPU for the threads in this registry, from the next sample.
+        //
+        void TrackThreads(const ThreadRegistry* threads)
+        {
+            threads_ = threads;
+        }
 
-                    lastTotalCounters_ = nextTotalCounters;
-                    lastTotalCountersTime_ = high_resolution_clock::now();
+        shared_ptr<const PerformanceSnapshot> Snapshot() const
+        {
+            return snapshot_.load();
+        }
 
-                    lastTotalCpuAverage_ = (float)deltaActiveTime / (float)(deltaActiveTime + deltaIdleTime);
-                }
-            }
+        vector<float> GetActiveCpu() const
+        {
+            return Snapshot()->MachineCpus;
+        }
+
+        float GetActiveTotalCpu() const
+        {
+            return Snapshot()->MachineTotalCpu;
+        }
 
-            return lastTotalCpuAverage_;
+        //
+        // Render the latest snapshot as a single JSON object.
+        //
+        json Render() const
+        {
+            auto snapshot = Snapshot();
+
+            json threads = json::object();
+            for (auto& threadCpu : snapshot->ThreadCpus)
+                threads[threadCpu.Name] = { {"tid", threadCpu.ThreadId}, {"cpu", threadCpu.Cpu} };
+
+            return json {
+                {"machinecpu", snapshot->MachineTotalCpu},
+                {"processcpu", snapshot->ProcessCpu},
+                {"threads", threads},
+                {"rss", snapshot->ResidentBytes},
+                {"minorfaults", snapshot->MinorFaults},
+                {"majorfaults", snapshot->MajorFaults},
+                {"voluntaryswitches", snapshot->VoluntarySwitches},
+                {"involuntaryswitches", snapshot->InvoluntarySwitches}
+            };
         }
 
     private:
-        void ReadCpuCounters(vector<CpuData>& entries)
+        void StopSampler()
         {
-            const string CpuName{"cpu"};
-            const std::size_t CpuNameLength = CpuName.size();
-            const string Total{"tot"};
+            if (!samplerThread_.joinable()) return;
 
-            ifstream fileStat("/proc/stat");
-            string line;
-            while(getline(fileStat, line))
             {
-                if (!line.compare(0, CpuNameLength, CpuName))
-                {
-                    istringstream cpuLine(line);
+                lock_guard<mutex> lock(mutex_);
+                quit_ = true;
+            }
+            cv_.notify_all();
 
-                    entries.emplace_back(CpuData());
-                    auto& entry = entries.back();
+            samplerThread_.join();
+        }
 
-                    cpuLine >> entry.cpu;
-                    if (entry.cpu.size() > CpuNameLength)
-                        entry.cpu.erase(0, CpuNameLength);
-                    else
-                        entry.cpu = Total;
+        void SamplerLoop()
+        {
+            unique_lock<mutex> lock(mutex_);
+            while (!cv_.wait_for(lock, minimumPerformanceInterval, [this]{ return quit_; }))
+                Sample();
+        }
 
-                    for (auto i = 0; i < numberOfCounters; ++i)
-                        cpuLine >> entry.times[i];
+        void Sample()
+        {
+            auto snapshot = make_shared<PerformanceSnapshot>();
+
+            auto now = steady_clock::now();
+            auto elapsed = std::chrono::duration_cast<nanoseconds>(now - lastSampleTime_).count();
+            lastSampleTime_ = now;
+            if (elapsed <= 0) return;
+
+            vector<CpuData> nextCounters;
+            ReadCpuCounters(nextCounters);
+            if (nextCounters.size() == lastCounters_.size())
+            {
+                for (auto i = 0; i < nextCounters.size(); i++)
+                {
+                    auto deltaIdleTime = GetIdleTime(nextCounters[i]) - GetIdleTime(lastCounters_[i]);
+                    auto deltaActiveTime = GetActiveTime(nextCounters[i]) - GetActiveTime(lastCounters_[i]);
+                    auto cpu = deltaActiveTime + deltaIdleTime > 0 ? (float)deltaActiveTime / (float)(deltaActiveTime + deltaIdleTime) : 0.0f;
+
+                    if (nextCounters[i].cpu == "tot")
+                        snapshot->MachineTotalCpu = cpu;
+                    else
+                        snapshot->MachineCpus.push_back(cpu);
                 }
             }
+            lastCounters_ = nextCounters;
+
+            rusage usage {};
+            getrusage(RUSAGE_SELF, &usage);
+            auto processNanoseconds = ToNanoseconds(usage.ru_utime) + ToNanoseconds(usage.ru_stime) - ToNanoseconds(lastUsage_.ru_utime) - ToNanoseconds(lastUsage_.ru_stime);
+            snapshot->ProcessCpu = (float)processNanoseconds / (float)elapsed;
+            snapshot->MinorFaults = usage.ru_minflt;
+            snapshot->MajorFaults = usage.ru_majflt;
+            snapshot->VoluntarySwitches = usage.ru_nvcsw;
+            snapshot->InvoluntarySwitches = usage.ru_nivcsw;
+            lastUsage_ = usage;
+
+            snapshot->ResidentBytes = ReadResidentPages() * sysconf(_SC_PAGESIZE);
+
+            vector<ThreadTime> nextThreadTimes;
+            auto* threads = threads_.load();
+            for (auto& [name, threadId] : threads ? threads->RegisteredThreads() : vector<std::pair<string, pid_t>>())
+            {
+                unsigned long long int runNanoseconds {};
+                if (!ReadThreadRunTime(threadId, runNanoseconds)) continue;
+
+                float cpu { 0.0f };
+                for (auto& lastThreadTime : lastThreadTimes_)
+                    if (lastThreadTime.ThreadId == threadId)
+                        cpu = (float)(runNanoseconds - lastThreadTime.RunNanoseconds) / (float)elapsed;
+
+                snapshot->ThreadCpus.push_back({ name, threadId, cpu });
+                nextThreadTimes.push_back({ threadId, runNanoseconds });
+            }
+            lastThreadTimes_ = nextThreadTimes;
+
+            snapshot_ = shared_ptr<const PerformanceSnapshot>(snapshot);
+        }
+
+        static long long int ToNanoseconds(const timeval& time)
+        {
+            return time.tv_sec * 1'000'000'000LL + time.tv_usec * 1'000LL;
+        }
+
+        //
+        // The first field of schedstat is the time the thread has spent on a CPU, in nanoseconds.
+        //
+        static bool ReadThreadRunTime(pid_t threadId, unsigned long long int& runNanoseconds)
+        {
+            ifstream schedStat("/proc/self/task/" + std::to_string(threadId) + "/schedstat");
+            return static_cast<bool>(schedStat >> runNanoseconds);
         }
 
-        bool ReadCpuTotalCounters(CpuData& entry)
+        static unsigned long long int ReadResidentPages()
         {
-            auto found {false};
+            unsigned long long int sizePages {};
+            unsigned long long int residentPages {};
+
+            ifstream statm("/proc/self/statm");
+            statm >> sizePages >> residentPages;
 
+            return residentPages;
+        }
+
+        //
+        // Read the total ("tot") and per-CPU lines of /proc/stat.
+        //
+        void ReadCpuCounters(vector<CpuData>& entries)
+        {
             const string CpuName{"cpu"};
             const std::size_t CpuNameLength = CpuName.size();
             const string Total{"tot"};
@@ -157,24 +313,22 @@ namespace embeddedpenguins::core::neuron::model
             string line;
             while(getline(fileStat, line))
             {
-                if (!line.compare(0, CpuNameLength, CpuName))
+                if (line.compare(0, CpuNameLength, CpuName)) continue;
+
+                entries.emplace_back(CpuData());
+                auto& entry = entries.back();
+
+                auto nameEnd = line.find(' ');
+                entry.cpu = nameEnd > CpuNameLength ? line.substr(CpuNameLength, nameEnd - CpuNameLength) : Total;
+
+                const char* next = line.c_str() + (nameEnd == string::npos ? line.size() : nameEnd);
+                for (auto i = 0; i < numberOfCounters; ++i)
                 {
-                    istringstream cpuLine(line);
-                    string lineName;
-                    cpuLine >> lineName;
-                    if (lineName.size() == CpuNameLength)
-                    {
-                        found = true;
-
-                        entry.cpu = Total;
-
-                        for (auto i = 0; i < numberOfCounters; ++i)
-                            cpuLine >> entry.times[i];
-                    }
+                    char* end {};
+                    entry.times[i] = std::strtoull(next, &end, 10);
+                    next = end;
                 }
             }
-
-            return found;
         }
 
         std::size_t GetIdleTime(const CpuData& entry)
@@ -7,6 +7,7 @@
 #include <filesystem>
 #include <map>
 #include <tuple>
+#include <atomic>
 
 #include "ConfigurationRepository.h"
 
@@ -22,6 +23,7 @@ namespace embeddedpenguins::core::neuron::model
     using time_point = std::chrono::high_resolution_clock::time_point;
     using Clock = std::chrono::high_resolution_clock;
     using std::ofstream;
+    using std::atomic;
 
     //
     // Allow recording of significant state changes with minimal impact 
@@ -33,7 +35,7 @@ namespace embeddedpenguins::core::neuron::model
     template<class RECORDTYPE>
     class Recorder
     {
-        unsigned long long int& ticks_;
+        const atomic<unsigned long long int>& ticks_;
         multimap<unsigned long long int, tuple<time_point, RECORDTYPE>> records_;
 
         static string& RecordFile()
@@ -49,7 +51,7 @@ namespace embeddedpenguins::core::neuron::model
         }
 
     public:
-        Recorder(unsigned long long int& ticks, ConfigurationRepository& configuration) :
+        Recorder(const atomic<unsigned long long int>& ticks, ConfigurationRepository& configuration) :
             ticks_(ticks)
         {
             Configuration() = &configuration;
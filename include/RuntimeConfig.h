@@ -0,0 +1,187 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+
+#include "nlohmann/json.hpp"
+
+#include "StreamTransport.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::string;
+    using std::vector;
+    using std::map;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::atomic;
+
+    using nlohmann::json;
+
+    //
+    // A service of the stack, from the 'services' section of the stack configuration.
+    // Every property other than 'host' is taken as a named port.
+    // A port or host may be a Unix domain or abstract socket ('unix:/path', '@name').
+    //
+    struct ServiceEndpoint
+    {
+        string Host {};
+        map<string, string> Ports {};
+
+        string Port(const string& portType) const
+        {
+            auto port = Ports.find(portType);
+            return port != Ports.end() ? port->second : string();
+        }
+
+        StreamEndpoint Endpoint(const string& portType) const
+        {
+            return StreamEndpoint::FromHostPort(Host, Port(portType));
+        }
+    };
+
+    //
+    // One entry of the 'OutputStreamers' array of the control file 'Execution' section.
+    //
+    struct OutputStreamerConfig
+    {
+        string Location {};
+        string ConnectionString {};
+        string Service {};
+    };
+
+    //
+    // The configuration as the running engine uses it, compiled from the
+    // settings, control and stack JSON whenever they change.  Paths are
+    // resolved and endpoints parsed when compiled, so code on the tick path
+    // reads plain fields only.  Directories are created only when a file is
+    // opened in them.
+    // A compiled configuration is never modified; a change publishes a new one.
+    //
+    struct RuntimeConfig
+    {
+        unsigned long long int Generation {};
+        bool Valid { false };
+
+        string ModelName {};
+        string DeploymentName {};
+        string EngineName {};
+
+        // The control this was compiled from, shared with the repository.
+        shared_ptr<const json> Control { make_shared<const json>(json::object()) };
+
+        // Empty if no record directory is configured, meaning do not record.
+        string RecordPath {};
+        string RecordCachePath {};
+        string WiringCachePath {};
+
+        map<string, ServiceEndpoint> Services {};
+        vector<OutputStreamerConfig> OutputStreamers {};
+
+        const ServiceEndpoint* FindService(const string& serviceName) const
+        {
+            auto service = Services.find(serviceName);
+            return service != Services.end() ? &service->second : nullptr;
+        }
+
+        static map<string, ServiceEndpoint> ParseServices(const json& stackConfiguration)
+        {
+            map<string, ServiceEndpoint> services {};
+            if (!stackConfiguration.is_object() || !stackConfiguration.contains("services")) return services;
+
+            const json& servicesJson = stackConfiguration["services"];
+            if (!servicesJson.is_object()) return services;
+
+            for (auto& [serviceName, serviceJson] : servicesJson.items())
+            {
+                if (!serviceJson.is_object()) continue;
+
+                auto& service = services[serviceName];
+                for (auto& [key, valueJson] : serviceJson.items())
+                {
+                    string value {};
+                    if (valueJson.is_string())
+                        value = valueJson.get<string>();
+                    else if (valueJson.is_number_integer())
+                        value = std::to_string(valueJson.get<long long int>());
+                    else
+                        continue;
+
+                    if (key == "host")
+                        service.Host = value;
+                    else
+                        service.Ports[key] = value;
+                }
+            }
+
+            return services;
+        }
+
+        static vector<OutputStreamerConfig> ParseOutputStreamers(const json& control)
+        {
+            vector<OutputStreamerConfig> outputStreamers {};
+            if (!control.is_object() || !control.contains("Execution")) return outputStreamers;
+
+            const json& executionJson = control["Execution"];
+            if (!executionJson.is_object() || !executionJson.contains("OutputStreamers")) return outputStreamers;
+
+            const json& outputStreamersJson = executionJson["OutputStreamers"];
+            if (!outputStreamersJson.is_array()) return outputStreamers;
+
+            auto stringProperty = [](const json& objectJson, const char* name) {
+                return objectJson.contains(name) && objectJson[name].is_string() ? objectJson[name].get<string>() : string();
+            };
+
+            for (auto& outputStreamerJson : outputStreamersJson)
+            {
+                if (!outputStreamerJson.is_object()) continue;
+
+                outputStreamers.push_back({
+                    stringProperty(outputStreamerJson, "Location"),
+                    stringProperty(outputStreamerJson, "ConnectionString"),
+                    stringProperty(outputStreamerJson, "Service")
+                });
+            }
+
+            return outputStreamers;
+        }
+    };
+
+    //
+    // Holds the current compiled configuration for lock-free reading from any thread.
+    // Copying takes the source's current configuration.
+    //
+    class RuntimeConfigSlot
+    {
+        atomic<shared_ptr<const RuntimeConfig>> config_ { make_shared<const RuntimeConfig>() };
+
+    public:
+        RuntimeConfigSlot() = default;
+
+        RuntimeConfigSlot(const RuntimeConfigSlot& other) :
+            config_(other.config_.load())
+        {
+        }
+
+        RuntimeConfigSlot& operator=(const RuntimeConfigSlot& other)
+        {
+            if (this != &other)
+                config_ = other.config_.load();
+
+            return *this;
+        }
+
+        shared_ptr<const RuntimeConfig> Load() const
+        {
+            return config_.load();
+        }
+
+        void Store(shared_ptr<const RuntimeConfig> config)
+        {
+            config_ = std::move(config);
+        }
+    };
+}
@@ -5,6 +5,7 @@
 #include <sstream>
 #include <vector>
 #include <iostream>
+#include <atomic>
 #include <dlfcn.h>
 
 #include "ConfigurationRepository.h"
@@ -15,12 +16,13 @@ namespace embeddedpenguins::core::neuron::model
     using std::string;
     using std::vector;
     using std::cout;
+    using std::atomic;
 
     using embeddedpenguins::core::neuron::model::ConfigurationRepository;
 
     class SensorInputProxy : public ISensorInput
     {
-        using SensorInputCreator = ISensorInput* (*)(const ConfigurationRepository&, unsigned long long int&, LogLevel&);
+        using SensorInputCreator = ISensorInput* (*)(const ConfigurationRepository&, const atomic<unsigned long long int>&, LogLevel&);
         using SensorInputDeleter = void (*)(ISensorInput*);
 
         const string sensorInputSharedLibraryPath_ {};
@@ -58,7 +60,7 @@ namespace embeddedpenguins::core::neuron::model
 
     public:
         // ISensorInput implementaton
-        virtual void CreateProxy(ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) override
+        virtual void CreateProxy(ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) override
         {
             LoadISensorInput();
             if (createSensorInput_ != nullptr)
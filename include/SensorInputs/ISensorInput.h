@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 
 #include <ConfigurationRepository.h>
 #include <Log.h>
@@ -10,13 +11,14 @@ namespace embeddedpenguins::core::neuron::model
 {
     using std::string;
     using std::vector;
+    using std::atomic;
 
     class ISensorInput
     {
     public:
         virtual ~ISensorInput() = default;
 
-        virtual void CreateProxy(ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) = 0;
+        virtual void CreateProxy(ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) = 0;
         virtual bool Connect(const string& connectionString) = 0;
         virtual bool Disconnect() = 0;
         virtual vector<unsigned long long>& AcquireBuffer() = 0;
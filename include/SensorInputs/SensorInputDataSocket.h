@@ -3,55 +3,66 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
 #include <memory>
-#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
 
 #include <nlohmann/json.hpp>
 
-#include "libsocket/exception.hpp"
-#include "libsocket/inetserverstream.hpp"
-
 #include "IQueryHandler.h"
 #include "Log.h"
 #include "SpikeSignalProtocol.h"
+#include "SpikeSignalDecoder.h"
+#include "StreamTransport.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::string;
     using std::vector;
-    using std::multimap;
     using std::unique_ptr;
-    using std::function;
+    using std::atomic;
 
     using nlohmann::json;
 
-    using libsocket::inet_stream;
-    using libsocket::inet_stream_server;
+    // Larger than any sender's packet; a larger size means the stream is corrupt.
+    constexpr SpikeSignalLengthFieldType MaximumSpikePacketSize { SpikeSignalProtocol::GetBufferSize(65'536) };
+    constexpr size_t SpikeReceiveChunkSize { 65'536 };
 
+    //
+    // One connection from an upstream engine.  Spike signal packets arrive
+    // as a byte stream into a receive buffer owned by the connection and
+    // reused for its lifetime, and are decoded from there in place, with
+    // each spike handed straight to the sink as sink(tick, neuronIndex).
+    //
     class SensorInputDataSocket
     {
-        unique_ptr<inet_stream> streamSocket_;
-        unsigned long long int& iterations_;
+        unique_ptr<StreamConnection> streamSocket_;
+        const atomic<unsigned long long int>& iterations_;
         LogLevel& loggingLevel_;
         const ConfigurationRepository& configuration_;
 
-        bool localOffsetCalculated_ { false };
-        unsigned int localOffset_ { 0 };
+        SpikeSignalDecoder decoder_;
+        vector<char> receiveBuffer_ { };
+        size_t receiveLength_ { 0 };
 
     public:
-        inet_stream* StreamSocket() const { return streamSocket_.get(); }
+        StreamConnection* StreamSocket() const { return streamSocket_.get(); }
 
     public:
-        SensorInputDataSocket(inet_stream_server* ccSocket, unsigned long long int& iterations, LogLevel& loggingLevel, const ConfigurationRepository& configuration) :
+        //
+        // Accept the pending connection on the listener.  If that fails, StreamSocket() is null.
+        //
+        SensorInputDataSocket(StreamListener* listener, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel, const ConfigurationRepository& configuration) :
             iterations_(iterations),
             loggingLevel_(loggingLevel),
-            streamSocket_(ccSocket->accept2()),
-            configuration_(configuration)
+            streamSocket_(listener->Accept()),
+            configuration_(configuration),
+            decoder_(iterations, loggingLevel, configuration)
         {
-            // Louis Ross - I modified libsocket to always apply SO_REUSEADDR=1 just before a server socket binds.
-            cout << "SensorInputDataSocket main ctor\n";
+            if (streamSocket_) cout << "SensorInputDataSocket main ctor with peer " << streamSocket_->Peer() << "\n";
         }
 
         SensorInputDataSocket(const SensorInputDataSocket& other) = delete;
@@ -62,93 +73,107 @@ namespace embeddedpenguins::core::neuron::model
         virtual ~SensorInputDataSocket()
         {
             cout << "SensorInputDataSocket dtor \n";
-            streamSocket_->shutdown(LIBSOCKET_READ | LIBSOCKET_WRITE);
+            if (streamSocket_) streamSocket_->Shutdown();
         }
-        
-        bool HandleInput(function<void(const multimap<int, unsigned long long int>&)> injectCallback)
+
+        //
+        // The socket is readable: read everything available into the
+        // receive buffer, and decode every packet now complete.
+        // Return false if the other end closed the socket or the stream is corrupt.
+        //
+        template<class SINK>
+        bool HandleInput(SINK& sink)
         {
-            // First field is the byte count.
-            SpikeSignalLengthFieldType byteCount {};
-            try
-            {
-                auto received = streamSocket_->rcv((void*)&byteCount, sizeof(byteCount));
+            ReserveReceiveSpace(SpikeReceiveChunkSize);
 
-                // Received zero means the other end closed the socket.
-                if (received == 0) return false;
+            auto received = streamSocket_->Receive(receiveBuffer_.data() + receiveLength_, receiveBuffer_.size() - receiveLength_);
 
-                if (received != sizeof(byteCount))
-                {
-                    cout << "SensorInputDataSocket::HandleInput received incorrect count field of size " << received << "\n";
-                    return true;
-                }
-
-                if (loggingLevel_ == LogLevel::Diagnostic) cout << "SensorInputDataSocket::HandleInput received count field of " << received << " bytes = " << (byteCount - PopulationIndexSize) / SpikeSignalSize << " spikes = " << SpikeSignalSize << " (" << sizeof(SpikeSignal::Tick) << " + " << sizeof(SpikeSignal::NeuronIndex) << ")\n";
-            }
-            catch(const libsocket::socket_exception& e)
-            {
-                cout << "SensorInputDataSocket::HandleInput received exception reading count field: " << e.mesg << "\n";
-                return false;
-            }
-            
-            // There is nothing following if the field count is smaller than needed for at least one spike.
-            if (byteCount < SpikeSignalProtocol::GetBufferSize(0)) return true;
+            // Received zero means the other end closed the socket.
+            if (received == 0) return false;
 
-            SpikeSignalProtocol protocol(byteCount);
-            if (!BuildInputBuffer(protocol, byteCount))
+            if (received < 0)
             {
+                cout << "SensorInputDataSocket::HandleInput failed reading: " << std::strerror(errno) << "\n";
                 return false;
             }
 
-            if (!localOffsetCalculated_)
-            {
-                auto* protocolPacket = protocol.GetProtocolBuffer();
-                cout << "Accepting spikes for population index " << protocolPacket->PopulationIndex << " and layer offset " << protocolPacket->LayerOffset << "\n";
-                localOffset_ = configuration_.ExpansionMap().ExpansionOffset(protocolPacket->PopulationIndex) + protocolPacket->LayerOffset;
-                cout << "Local offset calculated as " << localOffset_ << "\n";
-                localOffsetCalculated_ = true;
-            }
-
-            multimap<int, unsigned long long int> data;
-            for (SpikeSignalLengthFieldType index = 0; index < protocol.GetCapacity(); index++)
-            {
-                auto& signalSpike = protocol.GetElementAt(index);
-
-                //cout << "  Sensor input signaling index " << signalSpike.NeuronIndex << " at time " << signalSpike.Tick << "\n";
-                std::pair<int, int> element(signalSpike.Tick + iterations_, signalSpike.NeuronIndex + localOffset_);
-                data.insert(element);
-            }
+            receiveLength_ += received;
+            return DecodeReceived(sink);
+        }
 
-            if (loggingLevel_ != LogLevel::None)
-                cout << "Injecting input signal with " << data.size() << " spikes at tick " << iterations_ << "\n";
-            injectCallback(data);
+        //
+        // For receives that deliver the stream into buffers of their own (io_uring):
+        // append the bytes to the receive buffer, and decode every packet now complete.
+        // Return false if the stream is corrupt.
+        //
+        template<class SINK>
+        bool Consume(const char* bytes, size_t byteCount, SINK& sink)
+        {
+            ReserveReceiveSpace(byteCount);
 
-            return true;
+            std::memcpy(receiveBuffer_.data() + receiveLength_, bytes, byteCount);
+            receiveLength_ += byteCount;
+            return DecodeReceived(sink);
         }
 
     private:
-        bool BuildInputBuffer(SpikeSignalProtocol& protocol, SpikeSignalLengthFieldType byteCount)
+        //
+        // Decode each complete packet in place, then move any partial packet
+        // to the front of the buffer to be completed by later reads.
+        //
+        template<class SINK>
+        bool DecodeReceived(SINK& sink)
         {
-            // Skip past length field.
-            SpikeSignalPacket* buffer =  protocol.GetProtocolBuffer();
-            char* protocolBuffer = reinterpret_cast<char*>(buffer) + sizeof(SpikeSignalLengthFieldType);
-            
-            const ssize_t expectedBufferCount { byteCount };
-            ssize_t remainingBufferCount { byteCount };
-            ssize_t totalReceived { 0 };
-            do
+            size_t offset { 0 };
+            while (receiveLength_ - offset >= sizeof(SpikeEnvelope))
             {
-                auto received = streamSocket_->rcv((void*)(protocolBuffer + totalReceived), remainingBufferCount);
-                totalReceived += received;
-                remainingBufferCount -= received;
-
-                if (received == 0)
+                SpikeSignalLengthFieldType packetSize {};
+                std::memcpy(&packetSize, receiveBuffer_.data() + offset, sizeof(packetSize));
+                if (packetSize > MaximumSpikePacketSize)
                 {
-                    cout << "SensorInputDataSocket::BuildInputBuffer received incorrect buffer length " << totalReceived << ", expected " << expectedBufferCount << "\n";
+                    cout << "SensorInputDataSocket received invalid packet size " << packetSize << "\n";
                     return false;
                 }
-            } while (totalReceived != expectedBufferCount);
 
+                auto packetLength = sizeof(SpikeEnvelope) + packetSize;
+                if (receiveLength_ - offset < packetLength) break;
+
+                // Packets are decoded in place, so must be aligned; they always are unless malformed.
+                if (offset % alignof(SpikeSignalPacket) != 0)
+                {
+                    Compact(offset);
+                    offset = 0;
+                }
+
+                if (packetLength >= SpikeSignalProtocol::GetBufferSize(1))
+                {
+                    if (loggingLevel_ == LogLevel::Diagnostic) cout << "SensorInputDataSocket received packet of " << packetLength << " bytes\n";
+                    decoder_.Decode(*reinterpret_cast<const SpikeSignalPacket*>(receiveBuffer_.data() + offset), sink);
+                }
+
+                offset += packetLength;
+            }
+
+            Compact(offset);
             return true;
         }
+
+        void Compact(size_t consumed)
+        {
+            if (consumed == 0) return;
+
+            std::memmove(receiveBuffer_.data(), receiveBuffer_.data() + consumed, receiveLength_ - consumed);
+            receiveLength_ -= consumed;
+        }
+
+        //
+        // The buffer only grows, and only until it holds the largest packet
+        // plus a read; after that, receiving allocates nothing.
+        //
+        void ReserveReceiveSpace(size_t byteCount)
+        {
+            if (receiveBuffer_.size() - receiveLength_ < byteCount)
+                receiveBuffer_.resize(receiveLength_ + std::max(byteCount, static_cast<size_t>(SpikeReceiveChunkSize)));
+        }
     };
 }
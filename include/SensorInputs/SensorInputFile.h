@@ -3,6 +3,7 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <atomic>
 
 #include "nlohmann/json.hpp"
 
@@ -15,20 +16,21 @@ namespace embeddedpenguins::core::neuron::model
     using std::ifstream;
     using std::multimap;
     using std::make_pair;
+    using std::atomic;
 
     using nlohmann::json;
 
     class SensorInputFile : public ISensorInput
     {
         ConfigurationRepository& configuration_;
-        unsigned long long int& iterations_;
+        const atomic<unsigned long long int>& iterations_;
         LogLevel& loggingLevel_;
         nlohmann::ordered_json inputStream_ {};
         multimap<int, unsigned long long int> signalToInject_ {};
         vector<unsigned long long> signalToReturn_ {};
 
     public:
-        SensorInputFile(ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) :
+        SensorInputFile(ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) :
             configuration_(configuration),
             iterations_(iterations),
             loggingLevel_(loggingLevel)
@@ -36,14 +38,15 @@ namespace embeddedpenguins::core::neuron::model
         }
 
         // ISensorInput implementaton
-        virtual void CreateProxy(ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) override { }
+        virtual void CreateProxy(ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) override { }
 
         virtual bool Connect(const string& connectionString) override
         {
             auto sensorFile = connectionString;
-            if (configuration_.Control().contains("SensorInputFile"))
+            auto control = configuration_.Control();
+            if (control->contains("SensorInputFile"))
             {
-                const auto& sensorInputFile = configuration_.Control()["SensorInputFile"];
+                const auto& sensorInputFile = (*control)["SensorInputFile"];
                 if (sensorInputFile.is_string())
                     sensorFile = sensorInputFile.get<string>();
             }
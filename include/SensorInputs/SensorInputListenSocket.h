@@ -3,62 +3,51 @@
 #include <iostream>
 #include <memory>
 #include <map>
+#include <vector>
 #include <string>
 #include <utility>
-#include <functional>
-
-#include "libsocket/exception.hpp"
-#include "libsocket/inetserverstream.hpp"
-#include "libsocket/select.hpp"
-#include "libsocket/socket.hpp"
-
+#include <atomic>
 
 #include "Log.h"
+#include "EventSet.h"
+#include "StreamTransport.h"
 #include "ConfigurationRepository.h"
 #include "SensorInputDataSocket.h"
+#include "SensorInputShardSocket.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::map;
-    using std::multimap;
+    using std::vector;
     using std::string;
     using std::unique_ptr;
     using std::make_unique;
     using std::begin;
     using std::end;
-    using std::function;
-
-    using libsocket::socket;
-    using libsocket::inet_stream;
-    using libsocket::inet_stream_server;
-    using libsocket::selectset;
-
-    class SensorInputListenSocket
+    using std::atomic;
+
+    //
+    // The first shard of the sensor input front end, which also owns the
+    // listen socket.  Each new connection is accepted here and handed to
+    // whichever shard (including this one) currently reads the fewest
+    // connections, so upstream engines are spread across all reader threads.
+    //
+    class SensorInputListenSocket : public SensorInputShardSocket
     {
-        inet_stream_server server_ { };
-        const ConfigurationRepository& configuration_;
-        unsigned long long int& iterations_;
-        LogLevel& loggingLevel_;
+        StreamListener server_ { };
+        vector<SensorInputShardSocket*> shards_ { };
 
-        unique_ptr<selectset<socket>> selectSet_ { };
-
-        map<socket*, unique_ptr<SensorInputDataSocket>> ccSockets_ { };
-
-        multimap<int, unsigned long long int> signalToInject_ { };
-        function<void(const multimap<int, unsigned long long int>&)> InjectCallback_;
+    public:
+        bool Listening() const { return server_.Listening(); }
 
     public:
-        SensorInputListenSocket(const string& host, const string& port, const ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel,
-                                        function<void(const multimap<int, unsigned long long int>&)> injectCallback) :
-            server_(host, port, LIBSOCKET_IPv4),
-            configuration_(configuration),
-            iterations_(iterations),
-            loggingLevel_(loggingLevel),
-            InjectCallback_(injectCallback)
+        SensorInputListenSocket(const StreamEndpoint& endpoint, const ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) :
+            SensorInputShardSocket(configuration, iterations, loggingLevel)
         {
-            // Louis Ross - I modified libsocket to always apply SO_REUSEADDR=1 just before a server socket binds.
-            cout << "SensorInputListenSocket with fd=" << server_.getfd() << " listening at " << host << ":" << port << "\n";
+            if (server_.Listen(endpoint))
+                cout << "SensorInputListenSocket with fd=" << server_.Fd() << " listening at " << endpoint.ToString() << "\n";
+            shards_.push_back(this);
         }
 
         SensorInputListenSocket(const SensorInputListenSocket& other) = delete;
@@ -69,86 +58,66 @@ namespace embeddedpenguins::core::neuron::model
         virtual ~SensorInputListenSocket()
         {
             cout << "SensorInputListenSocket dtor\n";
-            server_.destroy();
+            server_.Close();
+        }
+
+        //
+        // Add another shard to share the accepted connections.
+        // Must be called before the worker thread starts.
+        //
+        void AddShard(SensorInputShardSocket* shard)
+        {
+            shards_.push_back(shard);
         }
 
         bool Initialize()
         {
-            MakeSelectSet();
-            cout << "SensorInputListenSocket Initialize\n";
+            cout << "SensorInputListenSocket Initialize with " << shards_.size() << " reader shards\n";
             return true;
         }
 
         //
-        // The main action handler.  Call periodically from the main loop.
-        // Wait a few milliseconds for one of the sockets in the select set
-        // to be readable, then handle all that are.
-        // Use dynamic_cast to distinguish between socket types.
+        // Called once on the worker thread, before any processing.
+        // In addition to the shard's own descriptors, wait on the listen socket.
         //
-        bool Process()
+        void Attach(EventSet& events)
         {
-            auto [readSockets, _] = selectSet_->wait(10'000);
+            SensorInputShardSocket::Attach(events);
+            events.Add(server_.Fd());
+        }
 
-            for (auto readSocket : readSockets)
+        //
+        // The main action handler, called from the worker thread
+        // whenever any of our descriptors are readable.
+        //
+        bool Process(EventSet& events)
+        {
+            for (auto fd : events.Ready())
             {
-                inet_stream_server* listenSocket = dynamic_cast<inet_stream_server*>(readSocket);
-                if (listenSocket != nullptr)
-                    AcceptNewConnection(readSocket, listenSocket);
-
-                inet_stream* dataSocket = dynamic_cast<inet_stream*>(readSocket);
-                if (dataSocket != nullptr)
-                    HandleInput(readSocket, dataSocket);
+                if (fd == server_.Fd())
+                    AcceptNewConnection();
+                else
+                    HandleReady(fd);
             }
 
             return false;
         }
 
-        void Cleanup()
-        {
-            // TODO - do we need to move the dtor code here?
-        }
-
     private:
-        void AcceptNewConnection(socket* readSocket, inet_stream_server* listenSocket)
+        void AcceptNewConnection()
         {
-            if (ccSockets_.find(readSocket) == end(ccSockets_))
-            {
-                cout << "SensorInputListenSocket found readable socket is listen socket, creating new connection\n";
-                auto dataSocket = make_unique<SensorInputDataSocket>(listenSocket, iterations_, loggingLevel_, configuration_);
-                ccSockets_[dataSocket->StreamSocket()] = std::move(dataSocket);
-                MakeSelectSet();
-            }
-        }
+            cout << "SensorInputListenSocket found readable socket is listen socket, creating new connection\n";
+            auto dataSocket = make_unique<SensorInputDataSocket>(&server_, iterations_, loggingLevel_, configuration_);
+            if (!dataSocket->StreamSocket()) return;
 
-        void HandleInput(socket* readSocket, inet_stream* dataSocket)
-        {
-            if (loggingLevel_ == LogLevel::Diagnostic)  cout << "SensorInputListenSocket found readable data socket, handling request\n";
-            auto iSocket = ccSockets_.find(readSocket);
-            if (iSocket != end(ccSockets_))
+            auto* leastLoaded = shards_.front();
+            for (auto* shard : shards_)
             {
-                if (!iSocket->second->HandleInput(InjectCallback_))
-                {
-                    cout << "SensorInputListenSocket: readable data socket closed by client\n";
-                    ccSockets_.erase(iSocket);
-                    MakeSelectSet();
-                }
+                if (shard->ConnectionCount() < leastLoaded->ConnectionCount())
+                    leastLoaded = shard;
             }
-        }
 
-        //
-        // Throw away the existing select set (if any) and create a new one
-        // with read function for the listen server socket and the streaming
-        // sockets of all current data sockets.
-        //
-        void MakeSelectSet()
-        {
-            selectSet_.reset(new selectset<socket>());
-
-            selectSet_->add_fd(server_, LIBSOCKET_READ);
-            for (auto iSocket = begin(ccSockets_); iSocket != end(ccSockets_); iSocket++)
-            {
-                selectSet_->add_fd(*iSocket->second->StreamSocket(), LIBSOCKET_READ);
-            }
+            leastLoaded->Adopt(std::move(dataSocket));
         }
     };
 }
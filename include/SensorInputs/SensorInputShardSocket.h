@@ -0,0 +1,415 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <map>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+#include "Log.h"
+#include "EventSet.h"
+#include "LockFreeQueue.h"
+#include "IoUring.h"
+#include "ConfigurationRepository.h"
+#include "SensorInputDataSocket.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::map;
+    using std::vector;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::begin;
+    using std::end;
+    using std::mutex;
+    using std::lock_guard;
+    using std::atomic;
+
+    //
+    // One spike received from an upstream engine, with the tick already
+    // converted to local time and the neuron index already converted to
+    // a local model index.
+    //
+    struct SensorInputSignal
+    {
+        int Tick { };
+        unsigned long long int NeuronIndex { };
+    };
+
+    constexpr unsigned int SensorInputQueueCapacity { 65'536 };
+    constexpr unsigned int SensorInputRingEntries { 256 };
+    constexpr unsigned int SensorInputReceiveBufferCount { 128 };
+    constexpr unsigned int SensorInputReceiveBufferSize { 4'096 };
+
+    //
+    // A shard of the sensor input front end.  Each shard owns a subset
+    // of the accepted data sockets and reads them on its own worker thread,
+    // feeding decoded spikes to its own single-producer/single-consumer queue.
+    // The worker thread sleeps in epoll until a data socket is readable or
+    // a new connection is adopted, so an idle shard uses no CPU.
+    // The engine thread drains the queues of all shards once per tick, so
+    // no lock is taken on the data path.
+    // If a burst ever fills the queue, the excess spills to a locked
+    // overflow list rather than blocking the reader.
+    //
+    // With io_uring, the shard instead posts one multishot receive per
+    // connection, drawing on a shared ring of provided buffers, and sleeps
+    // on the ring's completion eventfd.  Each wakeup then reads every
+    // connection's data from the completion ring with no further system
+    // calls, however many connections there are.
+    //
+    class SensorInputShardSocket
+    {
+    protected:
+        const ConfigurationRepository& configuration_;
+        const atomic<unsigned long long int>& iterations_;
+        LogLevel& loggingLevel_;
+
+        EventSet* events_ { };
+        map<int, unique_ptr<SensorInputDataSocket>> ccSockets_ { };
+
+        mutex adoptMutex_ { };
+        vector<unique_ptr<SensorInputDataSocket>> adoptedSockets_ { };
+        EventSignal adoptSignal_ { };
+        atomic<unsigned int> connectionCount_ { 0 };
+
+        unique_ptr<LockFreeQueue<SensorInputSignal>> queue_ { };
+        mutex overflowMutex_ { };
+        vector<SensorInputSignal> overflow_ { };
+        atomic<bool> overflowPending_ { false };
+
+        //
+        // Where decoders hand each received spike, straight onto the queue.
+        //
+        struct SignalSink
+        {
+            SensorInputShardSocket& Shard;
+
+            void operator()(int tick, unsigned long long int neuronIndex) const
+            {
+                Shard.Enqueue(SensorInputSignal { tick, neuronIndex });
+            }
+        };
+
+        SignalSink sink_ { *this };
+
+        // Declaration order matters: the ring must close before its buffers are released.
+        bool useIoUring_ { false };
+        IoUringBufferRing receiveBuffers_ { };
+        IoUring uring_ { };
+        EventSignal completionSignal_ { };
+        map<unsigned long long int, int> receives_ { };
+        // Receive ids start at 1; 0 marks ring operations that are not receives.
+        static constexpr unsigned long long int NotReceiveId { 0 };
+        unsigned long long int nextReceiveId_ { 1 };
+
+    public:
+        unsigned int ConnectionCount() const { return connectionCount_; }
+
+    public:
+        SensorInputShardSocket(const ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) :
+            configuration_(configuration),
+            iterations_(iterations),
+            loggingLevel_(loggingLevel)
+        {
+        }
+
+        SensorInputShardSocket(const SensorInputShardSocket& other) = delete;
+        SensorInputShardSocket& operator=(const SensorInputShardSocket& other) = delete;
+        SensorInputShardSocket(SensorInputShardSocket&& other) noexcept = delete;
+        SensorInputShardSocket& operator=(SensorInputShardSocket&& other) noexcept = delete;
+
+        virtual ~SensorInputShardSocket()
+        {
+            cout << "SensorInputShardSocket dtor\n";
+        }
+
+        bool Initialize()
+        {
+            return true;
+        }
+
+        //
+        // Receive through io_uring rather than epoll and recv.
+        // Must be called before the worker thread starts.
+        //
+        void UseIoUring()
+        {
+            useIoUring_ = true;
+        }
+
+        //
+        // Callable from any thread.  Hand an accepted data socket to this shard,
+        // and wake the shard's thread to start reading it.
+        //
+        void Adopt(unique_ptr<SensorInputDataSocket> dataSocket)
+        {
+            {
+                lock_guard<mutex> lock(adoptMutex_);
+                adoptedSockets_.push_back(std::move(dataSocket));
+            }
+
+            connectionCount_++;
+            adoptSignal_.Signal();
+        }
+
+        //
+        // Called on the worker thread once it is placed, so that the queue
+        // is first touched on the worker's NUMA node.
+        //
+        void ThreadStart()
+        {
+            queue_ = make_unique<LockFreeQueue<SensorInputSignal>>(SensorInputQueueCapacity);
+        }
+
+        //
+        // Called once on the worker thread, before any processing.
+        //
+        void Attach(EventSet& events)
+        {
+            events_ = &events;
+            events_->Add(adoptSignal_.Fd());
+
+            if (useIoUring_) AttachIoUring();
+        }
+
+        //
+        // The main action handler, called from the worker thread
+        // whenever any of our descriptors are readable.
+        //
+        bool Process(EventSet& events)
+        {
+            for (auto fd : events.Ready())
+                HandleReady(fd);
+
+            return false;
+        }
+
+        void Cleanup()
+        {
+        }
+
+        //
+        // Consumer (engine) thread only.  Hand every signal received since
+        // the last call to the visitor.
+        //
+        template<class VISITOR>
+        void Drain(VISITOR&& visitor)
+        {
+            if (queue_) queue_->Drain(visitor);
+
+            if (overflowPending_)
+            {
+                lock_guard<mutex> lock(overflowMutex_);
+                for (auto& signal : overflow_)
+                    visitor(signal);
+
+                overflow_.clear();
+                overflowPending_ = false;
+            }
+        }
+
+    protected:
+        //
+        // Handle one of the shard's own descriptors becoming readable.
+        //
+        void HandleReady(int fd)
+        {
+            if (fd < 0) return;
+
+            if (fd == adoptSignal_.Fd())
+                AdoptPendingSockets();
+            else if (useIoUring_ && fd == completionSignal_.Fd())
+                ReapReceives();
+            else
+                HandleInput(fd);
+        }
+
+        void AdoptPendingSockets()
+        {
+            adoptSignal_.Clear();
+
+            lock_guard<mutex> lock(adoptMutex_);
+            for (auto& dataSocket : adoptedSockets_)
+            {
+                auto fd = dataSocket->StreamSocket()->Fd();
+                if (useIoUring_)
+                {
+                    if (!ArmReceive(nextReceiveId_++, fd))
+                    {
+                        connectionCount_--;
+                        continue;
+                    }
+                }
+                else
+                    events_->Add(fd);
+                ccSockets_[fd] = std::move(dataSocket);
+            }
+
+            adoptedSockets_.clear();
+            if (useIoUring_) uring_.Submit();
+        }
+
+        void HandleInput(int fd)
+        {
+            if (loggingLevel_ == LogLevel::Diagnostic)  cout << "SensorInputShardSocket found readable data socket, handling request\n";
+            auto iSocket = ccSockets_.find(fd);
+            if (iSocket != end(ccSockets_))
+            {
+                if (!iSocket->second->HandleInput(sink_))
+                {
+                    cout << "SensorInputShardSocket: readable data socket closed by client\n";
+                    events_->Remove(fd);
+                    ccSockets_.erase(iSocket);
+                    connectionCount_--;
+                }
+            }
+        }
+
+    private:
+        void AttachIoUring()
+        {
+            if (!uring_.Setup(SensorInputRingEntries) ||
+                !receiveBuffers_.Setup(uring_, 0, SensorInputReceiveBufferCount, SensorInputReceiveBufferSize) ||
+                !uring_.RegisterEventFd(completionSignal_.Fd()))
+            {
+                cout << "SensorInputShardSocket unable to set up io_uring, using epoll\n";
+                uring_.Close();
+                useIoUring_ = false;
+                return;
+            }
+
+            events_->Add(completionSignal_.Fd());
+        }
+
+        //
+        // The next submission queue entry, submitting those already prepared
+        // to make room if the queue is full, or null if there is still none.
+        //
+        io_uring_sqe* NextSqe()
+        {
+            auto* sqe = uring_.NextSqe();
+            if (!sqe)
+            {
+                uring_.Submit();
+                sqe = uring_.NextSqe();
+            }
+
+            return sqe;
+        }
+
+        //
+        // Post a multishot receive on the connection; it stays armed,
+        // completing once per piece of data received, until it runs out of
+        // buffers or the connection ends.  Returns false if it could not be posted.
+        //
+        bool ArmReceive(unsigned long long int receiveId, int fd)
+        {
+            auto* sqe = NextSqe();
+            if (!sqe)
+            {
+                cout << "SensorInputShardSocket unable to post a receive for data socket " << fd << ", dropping the connection\n";
+                return false;
+            }
+
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = receiveBuffers_.Group();
+            sqe->user_data = receiveId;
+            receives_[receiveId] = fd;
+            return true;
+        }
+
+        //
+        // Cancel a receive still armed on a connection being dropped.  The ring
+        // holds its own reference to the socket, so closing it would neither end
+        // the connection nor stop the receive taking buffers.
+        //
+        void CancelReceive(unsigned long long int receiveId)
+        {
+            auto* sqe = NextSqe();
+            if (!sqe)
+            {
+                cout << "SensorInputShardSocket unable to cancel receive " << receiveId << "\n";
+                return;
+            }
+
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = receiveId;
+            sqe->user_data = NotReceiveId;
+        }
+
+        //
+        // Consume every completed receive, hand the buffers back, and re-arm
+        // any receive that stopped while its connection is still open.
+        // Completions for a connection already closed are discarded.
+        // A connection dropped for a corrupt stream is shut down, so the client
+        // sees it end, and its receive is cancelled if still armed.
+        //
+        void ReapReceives()
+        {
+            completionSignal_.Clear();
+
+            uring_.ReapCompletions([this](const io_uring_cqe& cqe) {
+                bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+                auto bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+                auto iReceive = receives_.find(cqe.user_data);
+                if (iReceive != receives_.end())
+                {
+                    auto fd = iReceive->second;
+                    auto iSocket = ccSockets_.find(fd);
+
+                    bool armed = (cqe.flags & IORING_CQE_F_MORE) != 0;
+                    bool open = iSocket != end(ccSockets_) && (cqe.res > 0 || cqe.res == -ENOBUFS);
+                    if (open && cqe.res > 0 && hasBuffer)
+                        open = iSocket->second->Consume(receiveBuffers_.Buffer(bufferId), cqe.res, sink_);
+
+                    if (open && !armed)
+                        armed = open = ArmReceive(cqe.user_data, fd);
+
+                    if (!open)
+                    {
+                        receives_.erase(iReceive);
+                        if (armed) CancelReceive(cqe.user_data);
+                        if (iSocket != end(ccSockets_))
+                        {
+                            if (cqe.res <= 0 && cqe.res != -ENOBUFS)
+                                cout << "SensorInputShardSocket: data socket closed by client\n";
+                            else
+                                iSocket->second->StreamSocket()->Shutdown();
+                            ccSockets_.erase(iSocket);
+                            connectionCount_--;
+                        }
+                    }
+                }
+
+                if (hasBuffer) receiveBuffers_.Recycle(bufferId);
+            });
+
+            receiveBuffers_.Publish();
+            if (uring_.Pending() > 0) uring_.Submit();
+        }
+
+        //
+        // Producer (worker) thread only.  Push a received signal to the queue,
+        // spilling to the overflow list only if the queue is full.
+        //
+        void Enqueue(const SensorInputSignal& signal)
+        {
+            if (!queue_->TryPush(signal))
+            {
+                lock_guard<mutex> lock(overflowMutex_);
+                overflow_.push_back(signal);
+                overflowPending_ = true;
+            }
+        }
+    };
+}
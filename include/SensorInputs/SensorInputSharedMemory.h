@@ -0,0 +1,100 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <future>
+
+#include "Log.h"
+#include "ThreadPlacement.h"
+#include "ConfigurationRepository.h"
+#include "SharedSpikeRing.h"
+#include "SpikeSignalDecoder.h"
+#include "SensorInputShardSocket.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::vector;
+    using std::thread;
+    using std::atomic;
+    using std::promise;
+
+    constexpr int SharedMemoryWaitMilliseconds { 100 };
+
+    //
+    // A sensor input shard fed by a shared spike ring rather than sockets,
+    // for upstream engines on the same host.  The ring has no descriptor to
+    // wait on, so the shard runs its own thread, sleeping on the ring's
+    // doorbell, and otherwise queues and drains spikes exactly as a socket shard.
+    // Each lane of the ring has its own sender, so each has its own decoder.
+    //
+    class SensorInputSharedMemory : public SensorInputShardSocket
+    {
+        SharedSpikeRing ring_ { };
+        vector<SpikeSignalDecoder> decoders_ { };
+        atomic<bool> quit_ { false };
+        thread readerThread_ { };
+
+    public:
+        const string& Name() const { return ring_.Name(); }
+
+    public:
+        SensorInputSharedMemory(const ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) :
+            SensorInputShardSocket(configuration, iterations, loggingLevel)
+        {
+            for (unsigned int lane = 0; lane < SharedSpikeLaneCount; lane++)
+                decoders_.emplace_back(iterations, loggingLevel, configuration);
+        }
+
+        SensorInputSharedMemory(const SensorInputSharedMemory& other) = delete;
+        SensorInputSharedMemory& operator=(const SensorInputSharedMemory& other) = delete;
+        SensorInputSharedMemory(SensorInputSharedMemory&& other) noexcept = delete;
+        SensorInputSharedMemory& operator=(SensorInputSharedMemory&& other) noexcept = delete;
+
+        virtual ~SensorInputSharedMemory()
+        {
+            Stop();
+        }
+
+        //
+        // Create the named ring and start reading it.  As with the worker
+        // threads, the queue is allocated on the placed reader thread
+        // before this returns.
+        //
+        bool Start(const string& name, const ThreadPlacement& placement)
+        {
+            if (!ring_.Create(name)) return false;
+
+            promise<void> started;
+            auto startedFuture = started.get_future();
+            readerThread_ = thread([this, placement, &started]() {
+                if (!placement.Empty() || !placement.Name.empty())
+                    placement.Apply();
+                ThreadStart();
+                started.set_value();
+
+                while (!quit_)
+                {
+                    ring_.Wait(SharedMemoryWaitMilliseconds);
+                    ring_.Drain([this](unsigned int lane, const SpikeSignalPacket& packet) {
+                        decoders_[lane].Decode(packet, sink_);
+                    });
+                }
+            });
+
+            startedFuture.wait();
+            return true;
+        }
+
+        void Stop()
+        {
+            quit_ = true;
+            if (readerThread_.joinable())
+                readerThread_.join();
+        }
+    };
+}
@@ -3,47 +3,54 @@
 #include <iostream>
 #include <fstream>
 #include <tuple>
-#include <map>
+#include <vector>
 #include <memory>
-#include <mutex>
+#include <atomic>
 
 #include "nlohmann/json.hpp"
 
-#include "WorkerThread.h"
+#include "EventWorkerThread.h"
+#include "ThreadPlacement.h"
 #include "Log.h"
 #include "ConfigurationRepository.h"
 #include "SensorInputs/ISensorInput.h"
+#include "SensorInputs/SensorInputStaging.h"
+#include "SensorInputs/SensorInputShardSocket.h"
 #include "SensorInputs/SensorInputListenSocket.h"
+#include "SensorInputs/SensorInputSharedMemory.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::ifstream;
     using std::tuple;
-    using std::multimap;
-    using std::make_pair;
+    using std::vector;
     using std::unique_ptr;
     using std::make_unique;
-    using std::mutex;
+    using std::atomic;
 
     using nlohmann::json;
 
     class SensorInputSocket : public ISensorInput
     {
         ConfigurationRepository& configuration_;
-        unsigned long long int& iterations_;
+        const atomic<unsigned long long int>& iterations_;
         LogLevel& loggingLevel_;
 
-        mutex mutex_ {};
-        multimap<int, unsigned long long int> signalToInject_ {};
+        SensorInputStaging staging_ {};
 
         vector<unsigned long long> signalToReturn_ {};
 
+        // Declaration order matters: the listen thread hands connections to the shards,
+        // so it must be joined (destroyed) before any shard or shard thread.
         unique_ptr<SensorInputListenSocket> sensorInput_ {};
-        unique_ptr<WorkerThread<SensorInputListenSocket>> sensorInputWorkerThread_ {};
+        vector<unique_ptr<SensorInputShardSocket>> sensorInputShards_ {};
+        vector<unique_ptr<EventWorkerThread<SensorInputShardSocket>>> sensorInputShardWorkerThreads_ {};
+        unique_ptr<EventWorkerThread<SensorInputListenSocket>> sensorInputWorkerThread_ {};
+        unique_ptr<SensorInputSharedMemory> sharedMemory_ {};
 
     public:
-        SensorInputSocket(ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) :
+        SensorInputSocket(ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) :
             configuration_(configuration),
             iterations_(iterations),
             loggingLevel_(loggingLevel)
@@ -51,32 +58,80 @@ namespace embeddedpenguins::core::neuron::model
         }
 
         // ISensorInput implementaton
-        virtual void CreateProxy(ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) override { }
+        virtual void CreateProxy(ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) override { }
 
         //
         // Interpret the connection string as a hostname and port number
         // to listen on.  The two fields are separated by a ':' character.
+        // A Unix domain or abstract endpoint ('unix:/path', '@name') listens
+        // there instead, for upstream senders on this host.
+        // The listen socket reads connections on its own thread, and
+        // additional reader threads may be configured to share the load.
+        //
+        // Engines on this host reach us through a shared spike ring instead,
+        // created alongside the listen socket under a name derived from the port.
+        // A connection string of the form 'shm://name' creates only a ring of that name.
+        //
+        // If the control file sets 'IoUring' in its 'Execution' section, and the
+        // kernel supports it, the reader threads receive through io_uring.
         //
         virtual bool Connect(const string& connectionString) override
         {
-            auto [host, port] = ParseConnectionString(connectionString);
+            auto ringName = SharedSpikeRing::NameFromConnectionString(connectionString);
+            if (!ringName.empty())
+                return StartSharedMemory(ringName);
+
+            auto endpoint = StreamEndpoint::Parse(connectionString, "0.0.0.0", "8001");
+            auto control = configuration_.Control();
+            auto listenerThreads = GetConfiguredListenerThreads(*control, connectionString);
+            auto useIoUring = IoUring::Configured(*control);
+
+            sensorInput_ = std::move(make_unique<SensorInputListenSocket>(endpoint, configuration_, iterations_, loggingLevel_));
+            if (!sensorInput_->Listening())
+            {
+                sensorInput_.reset();
+                return false;
+            }
 
-            sensorInput_ = std::move(make_unique<SensorInputListenSocket>(host, port, configuration_, iterations_, loggingLevel_,
-                [this](const multimap<int, unsigned long long int>& signalToInject) {
-                    unique_lock<mutex> lock(mutex_);
-                    signalToInject_.insert(signalToInject.begin(), signalToInject.end());
-                }));
+            for (auto shardIndex = 1; shardIndex < listenerThreads; shardIndex++)
+            {
+                auto shard = make_unique<SensorInputShardSocket>(configuration_, iterations_, loggingLevel_);
+                shard->Initialize();
+                if (useIoUring) shard->UseIoUring();
+                sensorInput_->AddShard(shard.get());
+                sensorInputShards_.push_back(std::move(shard));
+            }
             sensorInput_->Initialize();
+            if (useIoUring) sensorInput_->UseIoUring();
 
-            sensorInputWorkerThread_ = std::move(make_unique<WorkerThread<SensorInputListenSocket>>(*sensorInput_.get()));
+            auto shardIndex { 1 };
+            for (auto& shard : sensorInputShards_)
+            {
+                auto placement = ThreadPlacement::FromConfiguration(*control, "SensorInput" + std::to_string(shardIndex++), "SensorInput");
+                placement.Registry = &configuration_.Threads();
+                auto shardWorkerThread = make_unique<EventWorkerThread<SensorInputShardSocket>>(*shard.get(), placement);
+                shardWorkerThread->StartContinuous();
+                sensorInputShardWorkerThreads_.push_back(std::move(shardWorkerThread));
+            }
+
+            auto placement = ThreadPlacement::FromConfiguration(*control, "SensorInput0", "SensorInput");
+            placement.Registry = &configuration_.Threads();
+            sensorInputWorkerThread_ = std::move(make_unique<EventWorkerThread<SensorInputListenSocket>>(*sensorInput_.get(), placement));
             sensorInputWorkerThread_->StartContinuous();
 
+            if (endpoint.IsInet())
+                StartSharedMemory(SharedSpikeRing::NameForPort(endpoint.Port));
+
             return true;
         }
 
         virtual bool Disconnect() override
         {
-            sensorInputWorkerThread_->StopContinuous();
+            if (sharedMemory_) sharedMemory_->Stop();
+            if (sensorInputWorkerThread_) sensorInputWorkerThread_->StopContinuous();
+            for (auto& shardWorkerThread : sensorInputShardWorkerThreads_)
+                shardWorkerThread->StopContinuous();
+
             return true;
         }
 
@@ -88,55 +143,87 @@ namespace embeddedpenguins::core::neuron::model
         virtual vector<unsigned long long>& StreamInput(unsigned long long int tickNow) override
         {
             signalToReturn_.clear();
+            DrainShards();
 
-            auto done = signalToInject_.empty();
+            staging_.Release(tickNow, signalToReturn_);
 
-            unique_lock<mutex> lock(mutex_);
-            while (!done)
+            if (loggingLevel_ == LogLevel::Diagnostic && !signalToReturn_.empty())
             {
-                auto nextSignal = signalToInject_.begin();
-                //cout << "Sensor socket considering signal at tick " << nextSignal->first << "\n";
-                if (nextSignal->first < 0 || nextSignal->first <= tickNow)
-                {
-                    //cout << "Sensor socket adding offset " << nextSignal->second << " at tick " << nextSignal->first << " to signal to return\n";
-                    signalToReturn_.push_back(nextSignal->second);
-                    signalToInject_.extract(nextSignal);
-                    done = signalToInject_.empty();
-                }
-                else
+                cout << "Sensor socket injecting offsets ";
+                for (auto& offset : signalToReturn_)
                 {
-                    done = true;
-                    if (loggingLevel_ == LogLevel::Diagnostic && !signalToReturn_.empty())
-                    {
-                        cout << "Sensor socket injecting offsets ";
-                        for (auto& offset : signalToReturn_)
-                        {
-                            cout << offset << " ";
-                        }
-                        cout << " at tick " << tickNow << "\n";
-                    }
+                    cout << offset << " ";
                 }
-            };
+                cout << " at tick " << tickNow << "\n";
+            }
 
             return signalToReturn_;
         }
 
     private:
-        tuple<string, string> ParseConnectionString(const string& connectionString)
+        //
+        // Move everything received by all shards since the last tick into
+        // staging by tick.  This is the only place staging is touched,
+        // and it only happens on the engine thread, so no lock is needed.
+        //
+        void DrainShards()
+        {
+            auto merge = [this](const SensorInputSignal& signal) { staging_.Add(signal.Tick, signal.NeuronIndex); };
+
+            if (sensorInput_) sensorInput_->Drain(merge);
+            for (auto& shard : sensorInputShards_)
+                shard->Drain(merge);
+            if (sharedMemory_) sharedMemory_->Drain(merge);
+        }
+
+        bool StartSharedMemory(const string& ringName)
         {
-            string host {"0.0.0.0"};
-            string port {"8001"};
+            sharedMemory_ = make_unique<SensorInputSharedMemory>(configuration_, iterations_, loggingLevel_);
+            auto placement = ThreadPlacement::FromConfiguration(*configuration_.Control(), "SensorInputShm", "SensorInput");
+            placement.Registry = &configuration_.Threads();
+            if (!sharedMemory_->Start(ringName, placement))
+            {
+                sharedMemory_.reset();
+                return false;
+            }
 
-            auto colonPos = connectionString.find(":");
-            if (colonPos != string::npos)
+            return true;
+        }
+
+        //
+        // Find the number of reader threads configured for this listener, from the
+        // 'ListenerThreads' property of the matching 'InputStreamers' entry.
+        // Default is a single thread.
+        //
+        int GetConfiguredListenerThreads(const json& control, const string& connectionString)
+        {
+            int listenerThreads { 1 };
+
+            if (!control.contains("Execution")) return listenerThreads;
+
+            const json& executionJson = control["Execution"];
+            if (!executionJson.contains("InputStreamers")) return listenerThreads;
+
+            const json& inputStreamersJson = executionJson["InputStreamers"];
+            if (!inputStreamersJson.is_array()) return listenerThreads;
+
+            for (auto& inputStreamerJson : inputStreamersJson)
             {
-                auto tempHost = connectionString.substr(0, colonPos);
-                if (!tempHost.empty()) host = tempHost;
-                auto tempPort = connectionString.substr(colonPos + 1);
-                if (!tempPort.empty()) port = tempPort;
+                if (!inputStreamerJson.is_object() || !inputStreamerJson.contains("ListenerThreads")) continue;
+
+                if (inputStreamerJson.contains("ConnectionString"))
+                {
+                    const json& connectionStringJson = inputStreamerJson["ConnectionString"];
+                    if (connectionStringJson.is_string() && connectionStringJson.get<string>() != connectionString) continue;
+                }
+
+                const json& listenerThreadsJson = inputStreamerJson["ListenerThreads"];
+                if (listenerThreadsJson.is_number_integer() && listenerThreadsJson.get<int>() > 0)
+                    listenerThreads = listenerThreadsJson.get<int>();
             }
 
-            return {host, port};
+            cout << "SensorInputSocket using " << listenerThreads << " listener threads for " << connectionString << "\n";
+            return listenerThreads;
         }
     };
 }
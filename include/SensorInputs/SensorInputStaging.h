@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::vector;
+
+    constexpr unsigned int SensorInputStagingWindow { 64 };
+
+    //
+    // Received spikes waiting for their tick, on the engine thread.
+    // Spikes for the next SensorInputStagingWindow ticks go straight into a
+    // bucket for their tick; spikes further ahead wait in a heap until
+    // their tick comes within the window.  Buckets and heap keep their
+    // capacity, so once warmed up, staging and releasing spikes allocates nothing.
+    //
+    class SensorInputStaging
+    {
+        struct FutureSignal
+        {
+            long long int Tick { };
+            unsigned long long int NeuronIndex { };
+
+            // Ordered for a min-heap on tick.
+            bool operator<(const FutureSignal& other) const { return Tick > other.Tick; }
+        };
+
+        long long int nextTick_ { 0 };
+        vector<unsigned long long> due_ { };
+        vector<unsigned long long> buckets_[SensorInputStagingWindow] { };
+        vector<FutureSignal> future_ { };
+        size_t size_ { 0 };
+
+    public:
+        bool Empty() const { return size_ == 0; }
+        size_t Size() const { return size_; }
+
+    public:
+        //
+        // Stage a spike for a tick.  A spike for a tick already released
+        // (including any negative tick) is released with the next tick.
+        //
+        void Add(long long int tick, unsigned long long int neuronIndex)
+        {
+            size_++;
+
+            if (tick < nextTick_)
+                due_.push_back(neuronIndex);
+            else if (tick < nextTick_ + SensorInputStagingWindow)
+                buckets_[tick % SensorInputStagingWindow].push_back(neuronIndex);
+            else
+            {
+                future_.push_back(FutureSignal { tick, neuronIndex });
+                std::push_heap(future_.begin(), future_.end());
+            }
+        }
+
+        //
+        // Append every spike staged for this tick or earlier to 'released', in tick order.
+        //
+        void Release(unsigned long long int tickNow, vector<unsigned long long>& released)
+        {
+            auto tick = static_cast<long long int>(tickNow);
+
+            Take(due_, released);
+
+            if (tick >= nextTick_)
+            {
+                // Past the whole window, every bucket is due; visit each once.
+                auto last = std::min(tick, nextTick_ + SensorInputStagingWindow - 1);
+                for (auto dueTick = nextTick_; dueTick <= last; dueTick++)
+                    Take(buckets_[dueTick % SensorInputStagingWindow], released);
+
+                nextTick_ = tick + 1;
+            }
+
+            // Spikes now within the window move into buckets; any already due are released.
+            while (!future_.empty() && future_.front().Tick < nextTick_ + SensorInputStagingWindow)
+            {
+                std::pop_heap(future_.begin(), future_.end());
+                auto signal = future_.back();
+                future_.pop_back();
+
+                if (signal.Tick < nextTick_)
+                {
+                    released.push_back(signal.NeuronIndex);
+                    size_--;
+                }
+                else
+                    buckets_[signal.Tick % SensorInputStagingWindow].push_back(signal.NeuronIndex);
+            }
+        }
+
+    private:
+        void Take(vector<unsigned long long>& bucket, vector<unsigned long long>& released)
+        {
+            released.insert(released.end(), bucket.begin(), bucket.end());
+            size_ -= bucket.size();
+            bucket.clear();
+        }
+    };
+}
@@ -4,6 +4,7 @@
 #include <fstream>
 #include <map>
 #include <memory>
+#include <atomic>
 
 #include "nlohmann/json.hpp"
 
@@ -25,6 +26,7 @@ namespace embeddedpenguins::core::neuron::model
     using std::make_pair;
     using std::unique_ptr;
     using std::make_unique;
+    using std::atomic;
 
     using nlohmann::json;
 
@@ -37,7 +39,7 @@ namespace embeddedpenguins::core::neuron::model
     class SensorSonataFile : public ISensorInput
     {
         const ConfigurationRepository& configuration_;
-        unsigned long long int& iterations_;
+        const atomic<unsigned long long int>& iterations_;
         LogLevel& loggingLevel_;
         nlohmann::ordered_json inputStream_ {};
 
@@ -48,7 +50,7 @@ namespace embeddedpenguins::core::neuron::model
         vector<unsigned long long> signalToReturn_ {};
 
     public:
-        SensorSonataFile(const ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) :
+        SensorSonataFile(const ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) :
             configuration_(configuration),
             iterations_(iterations),
             loggingLevel_(loggingLevel)
@@ -56,7 +58,7 @@ namespace embeddedpenguins::core::neuron::model
         }
 
         // ISensorInput implementaton
-        virtual void CreateProxy(const ConfigurationRepository& configuration, unsigned long long int& iterations, LogLevel& loggingLevel) override { }
+        virtual void CreateProxy(const ConfigurationRepository& configuration, const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel) override { }
 
         virtual bool Connect(const string& connectionString) override
         {
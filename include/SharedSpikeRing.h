@@ -0,0 +1,404 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "SpikeSignalProtocol.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::atomic;
+    using std::uint32_t;
+    using std::memory_order_relaxed;
+    using std::memory_order_acquire;
+    using std::memory_order_release;
+    using std::memory_order_acq_rel;
+
+    constexpr std::string_view SharedSpikeRingScheme { "shm://" };
+    constexpr unsigned int SharedSpikeLaneCount { 8 };
+    constexpr unsigned int SharedSpikeSlotCount { 64 };
+    constexpr unsigned int SharedSpikeSlotSize { (SpikeSignalProtocol::GetBufferSize(SpikeSignalBufferCount + 1) + 63) / 64 * 64 };
+    constexpr uint32_t SharedSpikeRingMagic { 0x53504b52 };
+    constexpr uint32_t SharedSpikeRingVersion { 2 };
+    constexpr unsigned int SharedSpikeLivenessInterval { 100 };
+
+    static_assert(atomic<uint32_t>::is_always_lock_free, "Shared spike ring requires lock-free 32-bit atomics");
+
+    //
+    // The layout of a shared spike ring in shared memory.
+    // Each sending engine claims one lane, which is then a single-producer,
+    // single-consumer ring of fixed-size slots, each holding one spike signal
+    // packet exactly as it would be sent on a socket.  Every send rings the
+    // doorbell, a futex word the receiver sleeps on when all lanes are empty.
+    // The receiver's process id is kept in the layout, and cleared when it
+    // closes, so senders can tell when nobody will drain the ring.
+    //
+    struct SharedSpikeLane
+    {
+        alignas(64) atomic<uint32_t> Owner;     // Process id of the sender, zero if free.
+        alignas(64) atomic<uint32_t> Head;      // Next slot to write, written only by the sender.
+        alignas(64) atomic<uint32_t> Tail;      // Next slot to read, written only by the receiver.
+        alignas(64) char Slots[SharedSpikeSlotCount][SharedSpikeSlotSize];
+    };
+
+    struct SharedSpikeRingLayout
+    {
+        atomic<uint32_t> Magic;
+        uint32_t Version;
+        atomic<uint32_t> Receiver;              // Process id of the receiver, zero once closed.
+        alignas(64) atomic<uint32_t> Doorbell;
+        atomic<uint32_t> ReceiverWaiting;
+        SharedSpikeLane Lanes[SharedSpikeLaneCount];
+    };
+
+    //
+    // A shared-memory transport for spike signal packets between engines
+    // on the same host, in place of a loopback socket: no system call per
+    // packet unless the receiver is asleep, and no kernel copies.
+    //
+    // The receiver creates the ring by name (a POSIX shared memory object),
+    // and senders open it by the same name.  A ring is named either
+    // explicitly with a 'shm://name' connection string, or implicitly for a
+    // socket port, so that a sender to a local host:port finds the ring of
+    // the receiver listening on that port.
+    //
+    // A sender finds out that the receiver has gone, closing the ring or
+    // exiting without doing so, when it sends:  Send() then fails with
+    // ReceiverGone() set, and the sender should reopen or use a socket.
+    //
+    class SharedSpikeRing
+    {
+        string name_ {};
+        SharedSpikeRingLayout* layout_ { nullptr };
+        bool owner_ { false };
+        int lane_ { -1 };
+        unsigned long long int dropped_ { 0 };
+        bool receiverGone_ { false };
+
+    public:
+        bool Valid() const { return layout_ != nullptr; }
+        const string& Name() const { return name_; }
+        unsigned long long int Dropped() const { return dropped_; }
+        bool ReceiverGone() const { return receiverGone_; }
+
+    public:
+        SharedSpikeRing() = default;
+
+        SharedSpikeRing(const SharedSpikeRing& other) = delete;
+        SharedSpikeRing& operator=(const SharedSpikeRing& other) = delete;
+        SharedSpikeRing(SharedSpikeRing&& other) noexcept = delete;
+        SharedSpikeRing& operator=(SharedSpikeRing&& other) noexcept = delete;
+
+        ~SharedSpikeRing()
+        {
+            Close();
+        }
+
+        //
+        // The ring name for a connection string of the form 'shm://name', or empty if not one.
+        //
+        static string NameFromConnectionString(const string& connectionString)
+        {
+            if (connectionString.compare(0, SharedSpikeRingScheme.size(), SharedSpikeRingScheme) != 0)
+                return string();
+
+            return connectionString.substr(SharedSpikeRingScheme.size());
+        }
+
+        //
+        // The ring implicitly created by a receiver listening on a socket port.
+        //
+        static string NameForPort(const string& port)
+        {
+            return "embeddedpenguins-spikes-" + port;
+        }
+
+        //
+        // True if the host names this machine, so a ring may be used instead of a socket.
+        //
+        static bool IsLocalHost(const string& host)
+        {
+            if (host.empty() || host == "localhost" || host == "::1" || host.compare(0, 4, "127.") == 0)
+                return true;
+
+            char hostName[HOST_NAME_MAX + 1] { };
+            if (gethostname(hostName, sizeof(hostName)) != 0)
+                return false;
+
+            return host == hostName;
+        }
+
+        //
+        // Receiver.  Create the ring, replacing any left by a previous run.
+        //
+        bool Create(const string& name)
+        {
+            Close();
+            name_ = name;
+
+            auto objectName = "/" + name_;
+            shm_unlink(objectName.c_str());
+            auto fd = shm_open(objectName.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+            if (fd < 0)
+            {
+                cout << "SharedSpikeRing unable to create " << name_ << ": " << std::strerror(errno) << "\n";
+                return false;
+            }
+
+            if (ftruncate(fd, sizeof(SharedSpikeRingLayout)) != 0 || !Map(fd))
+            {
+                cout << "SharedSpikeRing unable to size " << name_ << ": " << std::strerror(errno) << "\n";
+                close(fd);
+                shm_unlink(objectName.c_str());
+                return false;
+            }
+            close(fd);
+
+            // A new object is zero filled, so every lane is free and empty.
+            owner_ = true;
+            layout_->Version = SharedSpikeRingVersion;
+            layout_->Receiver.store(static_cast<uint32_t>(getpid()), memory_order_relaxed);
+            layout_->Magic.store(SharedSpikeRingMagic, memory_order_release);
+
+            cout << "SharedSpikeRing created " << name_ << " with " << SharedSpikeLaneCount << " lanes of " << SharedSpikeSlotCount << " packets\n";
+            return true;
+        }
+
+        //
+        // Sender.  Open an existing ring, and claim a lane of it.
+        // Fails quietly if there is no such ring, or its receiver has gone,
+        // so the caller can fall back to a socket.
+        //
+        bool Open(const string& name)
+        {
+            Close();
+            name_ = name;
+
+            auto fd = shm_open(("/" + name_).c_str(), O_RDWR | O_CLOEXEC, 0);
+            if (fd < 0) return false;
+
+            struct stat status { };
+            if (fstat(fd, &status) != 0 || status.st_size < (off_t)sizeof(SharedSpikeRingLayout) || !Map(fd))
+            {
+                close(fd);
+                return false;
+            }
+            close(fd);
+
+            if (layout_->Magic.load(memory_order_acquire) != SharedSpikeRingMagic || layout_->Version != SharedSpikeRingVersion)
+            {
+                cout << "SharedSpikeRing " << name_ << " has an incompatible layout\n";
+                Unmap();
+                return false;
+            }
+
+            if (!ReceiverAlive())
+            {
+                cout << "SharedSpikeRing " << name_ << " was left by a receiver that has gone\n";
+                Unmap();
+                return false;
+            }
+
+            if (!ClaimLane())
+            {
+                cout << "SharedSpikeRing " << name_ << " has no free lane\n";
+                Unmap();
+                return false;
+            }
+
+            cout << "SharedSpikeRing opened " << name_ << ", sending on lane " << lane_ << "\n";
+            return true;
+        }
+
+        void Close()
+        {
+            if (!layout_) return;
+
+            if (lane_ >= 0)
+                layout_->Lanes[lane_].Owner.store(0, memory_order_release);
+            lane_ = -1;
+
+            if (owner_)
+                layout_->Receiver.store(0, memory_order_release);
+
+            Unmap();
+
+            if (owner_)
+                shm_unlink(("/" + name_).c_str());
+            owner_ = false;
+            receiverGone_ = false;
+        }
+
+        //
+        // Sender only.  Copy one packet into the next slot of our lane and ring the doorbell.
+        // If the receiver falls a whole lane behind, wait briefly for it, then drop
+        // the packet, counting it in Dropped().  While waiting, check that the
+        // receiver still exists; if it has gone, fail with ReceiverGone() set instead.
+        //
+        bool Send(const void* packet, size_t byteCount)
+        {
+            if (!layout_ || lane_ < 0 || receiverGone_) return false;
+            if (layout_->Receiver.load(memory_order_relaxed) == 0)
+            {
+                receiverGone_ = true;
+                return false;
+            }
+            if (byteCount > SharedSpikeSlotSize)
+            {
+                dropped_++;
+                return false;
+            }
+
+            auto& lane = layout_->Lanes[lane_];
+            auto head = lane.Head.load(memory_order_relaxed);
+            for (auto attempt = 0; head - lane.Tail.load(memory_order_acquire) >= SharedSpikeSlotCount; attempt++)
+            {
+                if (attempt % SharedSpikeLivenessInterval == 0 && !ReceiverAlive())
+                {
+                    receiverGone_ = true;
+                    return false;
+                }
+                if (attempt >= 1'000)
+                {
+                    dropped_++;
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            }
+
+            std::memcpy(lane.Slots[head % SharedSpikeSlotCount], packet, byteCount);
+            lane.Head.store(head + 1, memory_order_release);
+
+            layout_->Doorbell.fetch_add(1);
+            if (layout_->ReceiverWaiting.load())
+                Futex(&layout_->Doorbell, FUTEX_WAKE, INT_MAX, nullptr);
+
+            return true;
+        }
+
+        //
+        // Receiver only.  Sleep until a packet is sent or the timeout passes.
+        //
+        void Wait(int timeoutMilliseconds)
+        {
+            if (!layout_) return;
+
+            layout_->ReceiverWaiting.store(1);
+            auto doorbell = layout_->Doorbell.load();
+            if (!HasPackets())
+            {
+                timespec timeout { timeoutMilliseconds / 1'000, (timeoutMilliseconds % 1'000) * 1'000'000L };
+                Futex(&layout_->Doorbell, FUTEX_WAIT, doorbell, &timeout);
+            }
+            layout_->ReceiverWaiting.store(0);
+        }
+
+        //
+        // Receiver only.  Hand every packet sent since the last call to the
+        // visitor, as visitor(laneIndex, packet).  Each lane has one sender.
+        //
+        template<class VISITOR>
+        void Drain(VISITOR&& visitor)
+        {
+            if (!layout_) return;
+
+            for (unsigned int laneIndex = 0; laneIndex < SharedSpikeLaneCount; laneIndex++)
+            {
+                auto& lane = layout_->Lanes[laneIndex];
+                auto tail = lane.Tail.load(memory_order_relaxed);
+                auto head = lane.Head.load(memory_order_acquire);
+                for (; tail != head; tail++)
+                {
+                    const auto* packet = reinterpret_cast<const SpikeSignalPacket*>(lane.Slots[tail % SharedSpikeSlotCount]);
+                    if (packet->PacketSize + sizeof(SpikeEnvelope) <= SharedSpikeSlotSize && packet->PacketSize + sizeof(SpikeEnvelope) >= sizeof(SpikeSignalPacket))
+                        visitor(laneIndex, *packet);
+
+                    lane.Tail.store(tail + 1, memory_order_release);
+                }
+            }
+        }
+
+    private:
+        bool Map(int fd)
+        {
+            auto* address = mmap(nullptr, sizeof(SharedSpikeRingLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (address == MAP_FAILED) return false;
+
+            layout_ = static_cast<SharedSpikeRingLayout*>(address);
+            return true;
+        }
+
+        void Unmap()
+        {
+            if (layout_) munmap(layout_, sizeof(SharedSpikeRingLayout));
+            layout_ = nullptr;
+        }
+
+        //
+        // True unless the receiver has closed the ring, or its process no longer exists.
+        //
+        bool ReceiverAlive() const
+        {
+            auto receiver = layout_->Receiver.load(memory_order_acquire);
+            if (receiver == 0) return false;
+
+            return kill(static_cast<pid_t>(receiver), 0) == 0 || errno != ESRCH;
+        }
+
+        //
+        // Claim a free lane, or one whose sender has exited without releasing it.
+        // A reclaimed lane may hold packets from the exited sender; they are delivered first.
+        //
+        bool ClaimLane()
+        {
+            uint32_t processId = static_cast<uint32_t>(getpid());
+            for (unsigned int lane = 0; lane < SharedSpikeLaneCount; lane++)
+            {
+                auto& owner = layout_->Lanes[lane].Owner;
+                auto current = owner.load(memory_order_acquire);
+                // A sender we may not signal (EPERM) still exists; only ESRCH means it has gone.
+                if (current != 0 && (kill(static_cast<pid_t>(current), 0) == 0 || errno != ESRCH)) continue;
+
+                if (owner.compare_exchange_strong(current, processId, memory_order_acq_rel))
+                {
+                    lane_ = lane;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        bool HasPackets() const
+        {
+            for (auto& lane : layout_->Lanes)
+                if (lane.Head.load(memory_order_acquire) != lane.Tail.load(memory_order_relaxed))
+                    return true;
+
+            return false;
+        }
+
+        static long Futex(atomic<uint32_t>* word, int operation, uint32_t value, const timespec* timeout)
+        {
+            return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), operation, value, timeout, nullptr, 0);
+        }
+    };
+}
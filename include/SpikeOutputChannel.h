@@ -0,0 +1,374 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#include "ModelContext.h"
+#include "SpikeSignalProtocol.h"
+#include "SharedSpikeRing.h"
+#include "StreamTransport.h"
+#include "SpikeSendBatch.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::vector;
+    using std::map;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::shared_ptr;
+    using std::make_shared;
+    using std::weak_ptr;
+    using std::mutex;
+    using std::lock_guard;
+    using std::chrono::steady_clock;
+
+    constexpr size_t SpikeOutputChannelSendSize { 65'536 };
+    constexpr std::chrono::seconds SpikeOutputChannelReconnectPeriod { 1 };
+
+    //
+    // One connection to a receiving engine, shared by every interconnect
+    // output sending to it.  Each output appends its spike signal packet
+    // as a section of the channel's pending buffer; the sections go out
+    // together, in one send, once every member has flushed for the tick
+    // (or sooner, if the buffer grows past SpikeOutputChannelSendSize).
+    // The count of flushed members starts over each tick, and sections
+    // left pending from an earlier tick go out before any from a later one,
+    // so a member that misses a flush, or that the engine has detached
+    // but not yet disconnected, delays a send by at most one tick.
+    //
+    // Each section is a complete spike signal packet with its own
+    // population and layer, so the receiver needs nothing new: it already
+    // frames and routes packet by packet.  Dense models with many layer to
+    // layer interconnects between two engines thus open one connection,
+    // with one congestion window, instead of one per interconnect.
+    //
+    // Channels are shared by connection string through Acquire(); the last
+    // member to release a channel sends what is pending and closes it.
+    //
+    // If the receiver of a shared ring goes away, the channel reopens the
+    // ring (the receiver may have restarted), or else falls back to a socket
+    // to the same endpoint, trying at most once per reconnect period.
+    // Packets that cannot be delivered meanwhile are dropped and counted in
+    // the run measurements, which status reports.
+    //
+    class SpikeOutputChannel
+    {
+        ModelContext& context_;
+        string key_ {};
+        string ringName_ {};
+        StreamEndpoint endpoint_ {};
+        bool useSocket_ { false };
+        steady_clock::time_point lastReconnect_ {};
+        unique_ptr<StreamConnection> streamSocket_ {};
+        unique_ptr<SharedSpikeRing> ring_ {};
+
+        mutex mutex_ {};
+        vector<char> pending_ {};
+        unsigned int members_ { 0 };
+        unsigned int flushedMembers_ { 0 };
+        unsigned long long int flushTick_ { 0 };
+        unsigned long long int pendingTick_ { 0 };
+        unsigned long long int sends_ { 0 };
+        unsigned long long int sections_ { 0 };
+
+        struct Registry
+        {
+            mutex Mutex {};
+            map<string, weak_ptr<SpikeOutputChannel>> Channels {};
+        };
+
+    public:
+        const string& Key() const { return key_; }
+        bool Valid() const { return streamSocket_ || ring_; }
+        unsigned long long int Sends() const { return sends_; }
+        unsigned long long int Sections() const { return sections_; }
+
+    public:
+        SpikeOutputChannel(ModelContext& context, const string& key) :
+            context_(context),
+            key_(key)
+        {
+        }
+
+        SpikeOutputChannel(const SpikeOutputChannel& other) = delete;
+        SpikeOutputChannel& operator=(const SpikeOutputChannel& other) = delete;
+        SpikeOutputChannel(SpikeOutputChannel&& other) noexcept = delete;
+        SpikeOutputChannel& operator=(SpikeOutputChannel&& other) noexcept = delete;
+
+        ~SpikeOutputChannel()
+        {
+            lock_guard<mutex> lock(mutex_);
+            SendPending();
+
+            auto* batch = context_.SendBatch.load();
+            if (batch && streamSocket_) batch->SendNow(streamSocket_->Fd());
+
+            if (sections_ > 0)
+                cout << "SpikeOutputChannel " << key_ << " sent " << sections_ << " sections in " << sends_ << " sends\n";
+        }
+
+        //
+        // The shared channel for an interconnect, joining it as a member, or null
+        // if it cannot connect.  If the target engine is on this host, and
+        // listening with a shared spike ring, the ring is used instead of a
+        // socket.  A connection string of the form 'shm://name' requires the
+        // named ring.  A Unix domain or abstract endpoint ('unix:/path', '@name')
+        // is always a socket.
+        //
+        static shared_ptr<SpikeOutputChannel> Acquire(ModelContext& context, const string& connectionString)
+        {
+            auto ringName = SharedSpikeRing::NameFromConnectionString(connectionString);
+            auto endpoint = StreamEndpoint::Parse(connectionString, "localhost", "8001");
+            auto key = ringName.empty() ? endpoint.ToString() : connectionString;
+
+            return Acquire(context, key, [&ringName, &endpoint](SpikeOutputChannel& channel) {
+                if (!ringName.empty())
+                {
+                    channel.ringName_ = ringName;
+                    return;
+                }
+
+                if (endpoint.IsInet() && SharedSpikeRing::IsLocalHost(endpoint.Host))
+                    channel.ringName_ = SharedSpikeRing::NameForPort(endpoint.Port);
+                channel.endpoint_ = endpoint;
+                channel.useSocket_ = true;
+            });
+        }
+
+        //
+        // The shared channel for a service endpoint, always a socket.
+        //
+        static shared_ptr<SpikeOutputChannel> Acquire(ModelContext& context, const StreamEndpoint& endpoint)
+        {
+            return Acquire(context, endpoint.ToString(), [&endpoint](SpikeOutputChannel& channel) {
+                channel.endpoint_ = endpoint;
+                channel.useSocket_ = true;
+            });
+        }
+
+        //
+        // A member is leaving, and will not flush again.
+        //
+        void Release()
+        {
+            lock_guard<mutex> lock(mutex_);
+
+            if (members_ > 0) members_--;
+            if (flushedMembers_ >= members_)
+            {
+                SendPending();
+                flushedMembers_ = 0;
+            }
+        }
+
+        //
+        // Append one complete spike signal packet as a section, sending
+        // early only if the pending buffer has grown large, or holds
+        // sections of an earlier tick.
+        //
+        void Append(const void* section, size_t byteCount)
+        {
+            lock_guard<mutex> lock(mutex_);
+
+            auto tick = context_.Measurements.Iterations.load(memory_order_relaxed);
+            if (!pending_.empty() && tick != pendingTick_)
+                SendPending();
+
+            pendingTick_ = tick;
+            AppendSection(section, byteCount);
+            if (pending_.size() >= SpikeOutputChannelSendSize)
+                SendPending();
+        }
+
+        //
+        // A member is done for this tick.  Once every member is, send everything pending.
+        //
+        void Flush()
+        {
+            lock_guard<mutex> lock(mutex_);
+
+            auto tick = context_.Measurements.Iterations.load(memory_order_relaxed);
+            if (tick != flushTick_)
+            {
+                flushTick_ = tick;
+                flushedMembers_ = 0;
+            }
+
+            if (++flushedMembers_ >= members_)
+            {
+                SendPending();
+                flushedMembers_ = 0;
+            }
+        }
+
+    private:
+        template<class DESCRIBE>
+        static shared_ptr<SpikeOutputChannel> Acquire(ModelContext& context, const string& key, DESCRIBE&& describe)
+        {
+            static Registry registry {};
+            lock_guard<mutex> lock(registry.Mutex);
+
+            auto channel = registry.Channels[key].lock();
+            if (!channel)
+            {
+                channel = make_shared<SpikeOutputChannel>(context, key);
+                describe(*channel);
+                if (!channel->Open())
+                    return shared_ptr<SpikeOutputChannel>();
+
+                registry.Channels[key] = channel;
+            }
+            else
+            {
+                cout << "SpikeOutputChannel sharing connection to " << key << "\n";
+            }
+
+            lock_guard<mutex> channelLock(channel->mutex_);
+            channel->members_++;
+            return channel;
+        }
+
+        //
+        // Open the transport described by the ring name and endpoint:
+        // the ring if there is one with a live receiver, otherwise a socket if allowed.
+        //
+        bool Open()
+        {
+            if (!ringName_.empty() && TryOpenRing(ringName_))
+                return true;
+
+            return useSocket_ && TryConnect(endpoint_);
+        }
+
+        //
+        // With the lock held.  Reopen after losing the receiver, unless tried too recently.
+        //
+        bool Reconnect()
+        {
+            auto now = steady_clock::now();
+            if (now - lastReconnect_ < SpikeOutputChannelReconnectPeriod)
+                return false;
+
+            lastReconnect_ = now;
+            ring_.reset();
+            streamSocket_.reset();
+            return Open();
+        }
+
+        bool TryOpenRing(const string& ringName)
+        {
+            auto ring = make_unique<SharedSpikeRing>();
+            if (!ring->Open(ringName))
+            {
+                cout << "SpikeOutputChannel found no usable shared spike ring " << ringName << "\n";
+                return false;
+            }
+
+            ring_ = std::move(ring);
+            return true;
+        }
+
+        bool TryConnect(const StreamEndpoint& endpoint)
+        {
+            cout << "SpikeOutputChannel connecting to " << endpoint.ToString() << "\n";
+            streamSocket_ = StreamConnection::Connect(endpoint);
+
+            return streamSocket_ != nullptr;
+        }
+
+        void AppendSection(const void* section, size_t byteCount)
+        {
+            auto offset = pending_.size();
+            pending_.resize(offset + byteCount);
+            std::memcpy(pending_.data() + offset, section, byteCount);
+            sections_++;
+        }
+
+        //
+        // With the lock held.  A ring slot holds one packet, so the ring gets a
+        // send per section, which costs no system call.  A socket gets all
+        // the sections in one send, queued instead while the engine batches sends.
+        // If the ring's receiver has gone, what is left goes to the reopened
+        // transport, or is dropped if there is none.  A failed socket is closed,
+        // and reopened on a later send.
+        //
+        void SendPending()
+        {
+            if (pending_.empty()) return;
+
+            if (!ring_ && !streamSocket_ && !Reconnect())
+            {
+                DropPending();
+                return;
+            }
+
+            if (ring_)
+            {
+                size_t offset { 0 };
+                while (offset < pending_.size())
+                {
+                    const auto* section = reinterpret_cast<const SpikeSignalPacket*>(pending_.data() + offset);
+                    auto byteCount = section->PacketSize + sizeof(SpikeEnvelope);
+                    if (!ring_->Send(section, byteCount))
+                    {
+                        if (ring_->ReceiverGone()) break;
+                        context_.Measurements.SpikePacketsDropped.fetch_add(1, memory_order_relaxed);
+                    }
+                    offset += byteCount;
+                }
+
+                if (offset < pending_.size())
+                {
+                    cout << "SpikeOutputChannel " << key_ << " lost the receiver of shared spike ring " << ring_->Name() << "\n";
+                    ring_.reset();
+                    lastReconnect_ = steady_clock::time_point {};
+                    pending_.erase(pending_.begin(), pending_.begin() + offset);
+                    SendPending();
+                    return;
+                }
+            }
+            else if (streamSocket_)
+            {
+                auto* batch = context_.SendBatch.load();
+                if (batch)
+                    batch->Queue(streamSocket_->Fd(), pending_.data(), pending_.size());
+                else if (!streamSocket_->Send(pending_.data(), pending_.size()))
+                {
+                    cout << "SpikeOutputChannel unable to send to " << streamSocket_->Peer() << ": " << std::strerror(errno) << "\n";
+                    streamSocket_.reset();
+                    DropPending();
+                    return;
+                }
+            }
+
+            sends_++;
+            pending_.clear();
+        }
+
+        //
+        // With the lock held.  Count the pending sections as dropped, and discard them.
+        //
+        void DropPending()
+        {
+            unsigned long long int dropped { 0 };
+            for (size_t offset = 0; offset < pending_.size(); )
+            {
+                const auto* section = reinterpret_cast<const SpikeSignalPacket*>(pending_.data() + offset);
+                offset += section->PacketSize + sizeof(SpikeEnvelope);
+                dropped++;
+            }
+
+            context_.Measurements.SpikePacketsDropped.fetch_add(dropped, memory_order_relaxed);
+            pending_.clear();
+        }
+    };
+}
@@ -33,6 +33,8 @@ namespace embeddedpenguins::core::neuron::model
         bool isInterestedInSpikeTime_ { true };
         bool isInterestedInRefractoryTime_ { true };
         bool isInterestedInRecentTime_ { true };
+        NeuronRecordBuffer filtered_ {};
+        OutputInterest sampling_ {};
 
     public:
         const string& ErrorReason() const { return errorReason_; }
@@ -83,7 +85,7 @@ namespace embeddedpenguins::core::neuron::model
             errorReason_.clear();
 
             if (spikeOutput_ && valid_)
-                return spikeOutput_->Connect();
+                return CacheSampling(spikeOutput_->Connect());
 
             if (!spikeOutput_)
             {
@@ -109,7 +111,7 @@ namespace embeddedpenguins::core::neuron::model
             errorReason_.clear();
 
             if (spikeOutput_ && valid_)
-                return spikeOutput_->Connect(connectionString, filterBottom, filterLength, toIndex, toOffset);
+                return CacheSampling(spikeOutput_->Connect(connectionString, filterBottom, filterLength, toIndex, toOffset));
 
             if (!spikeOutput_)
             {
@@ -186,27 +188,22 @@ namespace embeddedpenguins::core::neuron::model
             return false;
         }
 
+        //
+        // The plugin's interest, or none at all if the plugin is not loaded.
+        //
+        virtual OutputInterest Interest() override
+        {
+            if (spikeOutput_ && valid_)
+                return spikeOutput_->Interest();
+
+            return OutputInterest {};
+        }
+
         virtual void StreamOutput(unsigned long long neuronIndex, short int activation, short int hpersensitive, unsigned short synapseIndex, short int synapseStrength, NeuronRecordType  type) override
         {
             errorReason_.clear();
 
-            switch (type)
-            {
-                case NeuronRecordType::Spike:
-                    if (!isInterestedInSpikeTime_) return;
-                    break;
-
-                case NeuronRecordType::Refractory:
-                    if (!isInterestedInRefractoryTime_) return;
-                    break;
-                    
-                case NeuronRecordType::Decay:
-                    if (!isInterestedInRecentTime_) return;
-                    break;
-                    
-                default:
-                    break;
-            }
+            if (!IsInterestedInType(type)) return;
 
             if (spikeOutput_ && valid_)
             {
@@ -231,6 +228,57 @@ namespace embeddedpenguins::core::neuron::model
             }
         }
 
+        //
+        // Forward the whole buffer in one call.  If the plugin is not interested
+        // in every record type, the records it wants are first copied to a
+        // reusable buffer, so the plugin still sees only those.
+        // The records were collected for the merged interest of all outputs,
+        // which may sample more often than this one; its other ticks are dropped.
+        // Sampling is on the tick the records were collected for, which a
+        // pipelined engine emits after it has moved on.
+        //
+        virtual void StreamRecords(const NeuronRecordBuffer& records) override
+        {
+            errorReason_.clear();
+
+            if (spikeOutput_ && valid_)
+            {
+                if (!sampling_.WantsTick(records.Tick))
+                    return;
+
+                if (isInterestedInSpikeTime_ && isInterestedInRefractoryTime_ && isInterestedInRecentTime_)
+                {
+                    spikeOutput_->StreamRecords(records);
+                    return;
+                }
+
+                filtered_.Clear();
+                for (size_t record = 0; record < records.Size(); record++)
+                    if (IsInterestedInType(records.Types[record]))
+                        filtered_.Add(records.NeuronIndexes[record], records.Activations[record], records.HyperSensitives[record], records.SynapseIndexes[record], records.SynapseStrengths[record], records.Types[record]);
+
+                if (!filtered_.Empty())
+                    spikeOutput_->StreamRecords(filtered_);
+                return;
+            }
+
+            if (!spikeOutput_)
+            {
+                std::ostringstream os;
+                os << "Error calling StreamRecords(): spike output library " 
+                    << spikeOutputSharedLibraryPath_ << " not loaded";
+                errorReason_ = os.str();
+            }
+
+            if (!valid_)
+            {
+                std::ostringstream os;
+                os << "Error calling StreamRecords(): invalid spike output library " 
+                    << spikeOutputSharedLibraryPath_;
+                errorReason_ = os.str();
+            }
+        }
+
         virtual void Flush() override
         {
             errorReason_.clear();
@@ -259,6 +307,18 @@ namespace embeddedpenguins::core::neuron::model
         }
 
     private:
+        //
+        // The plugin's interest is valid once it is connected, so its
+        // tick sampling is kept then for filtering its records.
+        //
+        bool CacheSampling(bool connected)
+        {
+            if (connected)
+                sampling_.SampleTicks = spikeOutput_->Interest().SampleTicks;
+
+            return connected;
+        }
+
         void LoadISpikeOutput()
         {
             errorReason_.clear();
@@ -314,5 +374,20 @@ namespace embeddedpenguins::core::neuron::model
 
             valid_ = true;
         }
+
+        bool IsInterestedInType(NeuronRecordType type) const
+        {
+            switch (type)
+            {
+                case NeuronRecordType::Spike:
+                    return isInterestedInSpikeTime_;
+                case NeuronRecordType::Refractory:
+                    return isInterestedInRefractoryTime_;
+                case NeuronRecordType::Decay:
+                    return isInterestedInRecentTime_;
+                default:
+                    return true;
+            }
+        }
     };
 }
@@ -5,6 +5,8 @@
 #include "nlohmann/json.hpp"
 
 #include "NeuronRecordCommon.h"
+#include "NeuronRecordBuffer.h"
+#include "OutputInterest.h"
 #include "ModelContext.h"
 
 namespace embeddedpenguins::core::neuron::model
@@ -24,7 +26,61 @@ namespace embeddedpenguins::core::neuron::model
         virtual bool Disconnect() = 0;
         virtual bool RespectDisableFlag() = 0;
         virtual bool IsInterestedIn(NeuronRecordType type) { return true; }
+
+        // The records this output consumes, valid once it is connected.
+        // The default is every neuron on every tick, with all fields, in the
+        // record types accepted by IsInterestedIn().
+        virtual OutputInterest Interest()
+        {
+            auto interest = OutputInterest::Everything();
+            interest.Types = 0;
+            for (auto type : { NeuronRecordType::InputSignal, NeuronRecordType::Decay, NeuronRecordType::Spike, NeuronRecordType::Refractory, NeuronRecordType::SynapseAdjust, NeuronRecordType::HyperSensitive })
+                if (IsInterestedIn(type))
+                    interest.Types |= RecordTypeBit(type);
+
+            return interest;
+        }
         virtual void StreamOutput(unsigned long long neuronIndex, short int activation, short int hypersensitive, unsigned short synapseIndex, short int synapseStrength, NeuronRecordType type) = 0;
+
+        // Stream a whole tick's records at once.  Outputs should override this to
+        // read only the fields they need; the default streams one record at a time.
+        // It is named apart from StreamOutput() so overriding either never hides the other.
+        virtual void StreamRecords(const NeuronRecordBuffer& records)
+        {
+            records.ForEach([this](unsigned long long neuronIndex, short int activation, short int hypersensitive, unsigned short synapseIndex, short int synapseStrength, NeuronRecordType type) {
+                StreamOutput(neuronIndex, activation, hypersensitive, synapseIndex, synapseStrength, type);
+            });
+        }
         virtual void Flush() = 0;
     };
+
+    //
+    // The union of the interests of a set of outputs (any container of
+    // pointers to ISpikeOutput), as the engine should collect for them.
+    // Outputs that respect the disable flag contribute only while recording
+    // is enabled, and then receive synapses, activations and hypersensitive
+    // values only while those are enabled too.
+    //
+    template<class OUTPUTS>
+    OutputInterest CombineOutputInterest(const OUTPUTS& outputs, const ModelContext& context)
+    {
+        OutputInterest combined {};
+
+        for (auto& output : outputs)
+        {
+            auto interest = output->Interest();
+            if (output->RespectDisableFlag())
+            {
+                if (!context.RecordEnable) continue;
+
+                interest.Synapses = interest.Synapses && context.RecordSynapseEnable;
+                interest.Activation = interest.Activation && context.RecordActivationEnable;
+                interest.Hypersensitive = interest.Hypersensitive && context.RecordHyperSensitiveEnable;
+            }
+
+            combined.Merge(interest);
+        }
+
+        return combined;
+    }
 }
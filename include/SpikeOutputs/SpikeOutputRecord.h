@@ -3,6 +3,7 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <atomic>
 
 #include "nlohmann/json.hpp"
 
@@ -16,6 +17,8 @@ namespace embeddedpenguins::core::neuron::model
     using std::ifstream;
     using std::multimap;
     using std::make_pair;
+    using std::shared_ptr;
+    using std::atomic;
 
     using nlohmann::json;
 
@@ -26,16 +29,19 @@ namespace embeddedpenguins::core::neuron::model
     {
         ModelContext& context_;
         ConfigurationRepository& configuration_;
-        unsigned long long int& ticks_;
+        const atomic<unsigned long long int>& ticks_;
         Recorder<RECORDTYPE> recorder_;
         unsigned int lineCount_ { };
+        // Refreshed once per tick, at Flush(), so records never wait on a reload.
+        shared_ptr<const RuntimeConfig> runtime_ {};
 
     public:
         SpikeOutputRecord(ModelContext& context) :
             context_(context),
             configuration_(context_.Configuration),
             ticks_(context_.Measurements.Iterations),
-            recorder_(ticks_, configuration_)
+            recorder_(ticks_, configuration_),
+            runtime_(configuration_.Runtime())
         {
             cout << "SpikOutputRecord constructor\n";
         }
@@ -67,9 +73,9 @@ namespace embeddedpenguins::core::neuron::model
         
         virtual void StreamOutput(unsigned long long neuronIndex, short int activation, short int hypersensitive, unsigned short synapseIndex, short int synapseStrength, NeuronRecordType type) override
         {
-            // If the configured record file path is empth, don't both recording.
-            if (configuration_.ComposeRecordPath().empty()) return;
-            
+            // If the configured record file path is empty, don't bother recording.
+            if (runtime_->RecordPath.empty()) return;
+
             RECORDTYPE record(type, neuronIndex, activation, hypersensitive, synapseIndex, synapseStrength);
             recorder_.Record(record);
 
@@ -82,6 +88,7 @@ namespace embeddedpenguins::core::neuron::model
             recorder_.Print();
             
             lineCount_ = 0;
+            runtime_ = configuration_.Runtime();
         }
 
     private:
@@ -6,9 +6,6 @@
 #include <tuple>
 #include <vector>
 
-#include "libsocket/exception.hpp"
-#include "libsocket/inetclientstream.hpp"
-
 #include "nlohmann/json.hpp"
 
 #include "ModelContext.h"
@@ -16,20 +13,18 @@
 #include "ConfigurationRepository.h"
 #include "SpikeOutputs/ISpikeOutput.h"
 #include "SpikeSignalProtocol.h"
+#include "StreamTransport.h"
+#include "SpikeOutputChannel.h"
 
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
     using std::ifstream;
-    using std::unique_ptr;
-    using std::make_unique;
+    using std::shared_ptr;
     using std::numeric_limits;
     using std::tuple;
     using std::vector;
 
-    using libsocket::inet_stream;
-    using libsocket::socket_exception;
-
     using nlohmann::json;
 
     class SpikeOutputSocket : public ISpikeOutput
@@ -37,11 +32,18 @@ namespace embeddedpenguins::core::neuron::model
         ModelContext& context_;
         const ConfigurationRepository& configuration_;
 
-        unique_ptr<inet_stream> streamSocket_ {};
+        shared_ptr<SpikeOutputChannel> channel_ {};
         SpikeSignalProtocol protocol_ {};
         unsigned int filterBottom_ {};
         unsigned int filterTop_ { numeric_limits<unsigned int>::max() };
 
+        // For an interconnect, the expansion holding the filtered layer,
+        // and the layer's place within it.
+        bool interconnect_ { false };
+        unsigned short int sourceExpansion_ {};
+        unsigned long int layerBottom_ {};
+        unsigned long int layerTop_ {};
+
     public:
         SpikeOutputSocket(ModelContext& context) :
             context_(context),
@@ -50,6 +52,11 @@ namespace embeddedpenguins::core::neuron::model
             cout << "SpikeOutputSocket constructor\n";
         }
 
+        virtual ~SpikeOutputSocket()
+        {
+            Disconnect();
+        }
+
         // ISpikeOutput implementaton
         virtual void CreateProxy(ModelContext& context) override { }
 
@@ -68,15 +75,16 @@ namespace embeddedpenguins::core::neuron::model
                 cout << "Developing connection string from service " << service << "\n";
                 auto [serviceName, portType] = ParseConnectionString(service, "", "");
                 cout << "Developing connection string from service " << serviceName << ", port " << portType << "\n";
-                auto [host, port] = GetServiceConnection(serviceName, portType);
-                cout << "Connecting to host " << host << ", port " << port << "\n";
-                connected = TryConnect(host, port);
+                auto endpoint = GetServiceConnection(serviceName, portType);
+                cout << "Connecting to " << endpoint.ToString() << "\n";
+                channel_ = SpikeOutputChannel::Acquire(context_, endpoint);
+                connected = channel_ != nullptr;
             }
 
             if (!connected && !connectionString.empty())
             {
-                auto [host, port] = ParseConnectionString(connectionString, "localhost", "8001");
-                connected = TryConnect(host, port);
+                channel_ = SpikeOutputChannel::Acquire(context_, StreamEndpoint::Parse(connectionString, "localhost", "8001"));
+                connected = channel_ != nullptr;
             }
 
             return connected;
@@ -87,24 +95,33 @@ namespace embeddedpenguins::core::neuron::model
         // and an expansion/layer on an engine that may be the same or different.
         // This form manages a filter, so that only spikes from the source expansion/layer
         // are sent to the specified connection.
+        // Every interconnect to the same connection string shares one
+        // connection (see SpikeOutputChannel), so this output's spikes go
+        // out as one section of a packet shared with the others.
+        // The filtered layer must lie within one expansion on this engine.
         //
         virtual bool Connect(const string& connectionString, unsigned int filterBottom, unsigned int filterLength, unsigned int toIndex, unsigned int toOffset) override
         {
             filterBottom_ = filterBottom;
             filterTop_ = filterBottom + filterLength;
-            protocol_ = SpikeSignalProtocol(toIndex, toOffset, 250);
-
-            bool connected { false };
+            if (!FindSourceLayer())
+                return false;
 
-            auto [host, port] = ParseConnectionString(connectionString, "localhost", "8001");
-            connected = TryConnect(host, port);
+            protocol_ = SpikeSignalProtocol(toIndex, toOffset, 250);
 
-            return connected;
+            channel_ = SpikeOutputChannel::Acquire(context_, connectionString);
+            return channel_ != nullptr;
         }
 
         virtual bool Disconnect() override
         {
-            streamSocket_.release();
+            if (channel_)
+            {
+                AppendSection();
+                channel_->Release();
+            }
+
+            channel_.reset();
 
             return true;
         }
@@ -120,65 +137,144 @@ namespace embeddedpenguins::core::neuron::model
             //return type == NeuronRecordType::Refractory;
         }
 
+        //
+        // Spikes only, from the filtered neurons, with no optional fields.
+        //
+        virtual OutputInterest Interest() override
+        {
+            OutputInterest interest { .Types = RecordTypeBit(NeuronRecordType::Spike) };
+            if (filterBottom_ > 0 || filterTop_ < numeric_limits<unsigned int>::max())
+                interest.Ranges.push_back({ filterBottom_, filterTop_ });
+
+            return interest;
+        }
+
         virtual void StreamOutput(unsigned long long neuronIndex, short int activation, short int hypersensitive, unsigned short synapseIndex, short int synapseStrength, NeuronRecordType type) override
         {
-            // The default filter used by the default Connect(), is wide open.
-            if (neuronIndex < filterBottom_ || neuronIndex >= filterTop_)
-                return;
+            auto& expansionMap = configuration_.ExpansionMap();
+            auto localIndex = expansionMap.LocalIndex(neuronIndex);
+            unsigned int signalIndex { 0 };
 
-            SpikeSignal sample { static_cast<int>(context_.Measurements.Iterations), static_cast<unsigned int>(neuronIndex) - filterBottom_ };
-            if (protocol_.Buffer(sample)) Flush();
+            if (interconnect_)
+            {
+                unsigned short int expansionId { 0 };
+                unsigned long int offset { 0 };
+                if (!expansionMap.FindExpansion(localIndex, expansionId, offset) || !InSourceLayer(expansionId, offset))
+                    return;
+
+                signalIndex = static_cast<unsigned int>(offset - layerBottom_);
+            }
+            else
+            {
+                // The default filter used by the default Connect(), is wide open.
+                if (localIndex < filterBottom_ || localIndex >= filterTop_)
+                    return;
+
+                signalIndex = static_cast<unsigned int>(localIndex) - filterBottom_;
+            }
+
+            SpikeSignal sample { static_cast<int>(context_.Measurements.Iterations), signalIndex };
+            if (protocol_.Buffer(sample)) AppendSection();
         }
 
-        virtual void Flush() override
+        //
+        // Only the spike records are sent, so only the type and index arrays are read.
+        // Records carry storage indexes.  An interconnect routes them by expansion,
+        // translating the whole buffer at once; otherwise the local index is sent.
+        //
+        virtual void StreamRecords(const NeuronRecordBuffer& records) override
         {
-            if (protocol_.IsEmpty()) return;
+            auto& expansionMap = configuration_.ExpansionMap();
+            auto tick = static_cast<int>(records.Tick);
 
-            try
+            if (interconnect_)
             {
-                if (context_.LoggingLevel != LogLevel::None)
-                {
-                    cout << "Spike output socket sending " << protocol_.GetCurrentBufferCount() << " spikes: ";
+                expansionMap.TranslateToExpansions(records.NeuronIndexes.data(), records.Size(),
+                    [this, &records, tick](size_t record, unsigned short int expansionId, unsigned long int offset) {
+                        if (records.Types[record] != NeuronRecordType::Spike || !InSourceLayer(expansionId, offset)) return;
 
-                    if (context_.LoggingLevel == LogLevel::Diagnostic)
-                    {
-                        auto* spike = protocol_.GetProtocolBuffer()->GetSpikeSignals();
-                        auto baseTick = spike->Tick;
-                        for (auto spikeIndex = 0; spikeIndex < protocol_.GetCurrentBufferCount(); spikeIndex++, spike++)
-                        {
-                            spike->Tick -= baseTick;
-                            if (context_.LoggingLevel == LogLevel::Diagnostic) cout << "(" << spike->Tick << "," << spike->NeuronIndex << ") ";
-                        }
-                    }
-                    cout << " at tick " << context_.Measurements.Iterations << "\n";
-                }
-                
-                // First field is the count of structs in the array, not the byte count.
-                streamSocket_->snd((void*)protocol_.GetProtocolBuffer(), protocol_.GetBufferSize());
-            } catch (const socket_exception& exc)
+                        SpikeSignal sample { tick, static_cast<unsigned int>(offset - layerBottom_) };
+                        if (protocol_.Buffer(sample)) AppendSection();
+                    });
+                return;
+            }
+
+            for (size_t record = 0; record < records.Size(); record++)
             {
-                cout << "SpikeOutputSocket Flush() caught exception: " << exc.mesg;
+                if (records.Types[record] != NeuronRecordType::Spike) continue;
+
+                auto neuronIndex = expansionMap.LocalIndex(records.NeuronIndexes[record]);
+                if (neuronIndex < filterBottom_ || neuronIndex >= filterTop_) continue;
+
+                SpikeSignal sample { tick, static_cast<unsigned int>(neuronIndex) - filterBottom_ };
+                if (protocol_.Buffer(sample)) AppendSection();
             }
-            
-            protocol_.Reset();
+        }
+
+        //
+        // Done for this tick.  The channel sends once all its members are.
+        //
+        virtual void Flush() override
+        {
+            AppendSection();
+            if (channel_) channel_->Flush();
         }
 
     private:
-        bool TryConnect(const string& host, const string& port)
+        //
+        // Find the expansion holding the filtered layer, and the layer's place
+        // within it, so this interconnect's records are routed by expansion.
+        //
+        bool FindSourceLayer()
         {
-            try
-            {
-                cout << "SpikeOutputSocket Connect() connecting to " << host << ":" << port << "\n";
-                streamSocket_ = make_unique<inet_stream>(host, port, LIBSOCKET_IPv4);
-            } catch (const socket_exception& exc)
+            auto& expansionMap = configuration_.ExpansionMap();
+            unsigned long int layerBottom { 0 };
+            if (!expansionMap.FindExpansion(filterBottom_, sourceExpansion_, layerBottom) || filterTop_ > expansionMap.ExpansionEnd(sourceExpansion_))
             {
-                cout << "SpikeOutputSocket Connect() caught exception: " << exc.mesg;
+                cout << "Spike output socket filter from " << filterBottom_ << " to " << filterTop_ << " is not within one expansion of this engine, not connecting\n";
                 return false;
             }
 
+            interconnect_ = true;
+            layerBottom_ = layerBottom;
+            layerTop_ = layerBottom + (filterTop_ - filterBottom_);
             return true;
         }
 
+        bool InSourceLayer(unsigned short int expansionId, unsigned long int offset) const
+        {
+            return expansionId == sourceExpansion_ && offset >= layerBottom_ && offset < layerTop_;
+        }
+
+        //
+        // Hand the buffered spikes to the channel as one section.
+        //
+        void AppendSection()
+        {
+            if (protocol_.IsEmpty()) return;
+
+            if (context_.LoggingLevel != LogLevel::None)
+            {
+                cout << "Spike output socket sending " << protocol_.GetCurrentBufferCount() << " spikes: ";
+
+                if (context_.LoggingLevel == LogLevel::Diagnostic)
+                {
+                    auto* spike = protocol_.GetProtocolBuffer()->GetSpikeSignals();
+                    auto baseTick = spike->Tick;
+                    for (auto spikeIndex = 0; spikeIndex < protocol_.GetCurrentBufferCount(); spikeIndex++, spike++)
+                    {
+                        spike->Tick -= baseTick;
+                        if (context_.LoggingLevel == LogLevel::Diagnostic) cout << "(" << spike->Tick << "," << spike->NeuronIndex << ") ";
+                    }
+                }
+                cout << " at tick " << context_.Measurements.Iterations << "\n";
+            }
+
+            if (channel_) channel_->Append(protocol_.GetProtocolBuffer(), protocol_.GetBufferSize());
+
+            protocol_.Reset();
+        }
+
         tuple<string, string> ParseConnectionString(const string& connectionString, const string& defaultHost, const string& defaultPort)
         {
             string host {defaultHost};
@@ -196,38 +292,18 @@ namespace embeddedpenguins::core::neuron::model
             return {host, port};
         }
 
-        tuple<string, string> GetServiceConnection(const string& serviceName, const string& portType)
+        StreamEndpoint GetServiceConnection(const string& serviceName, const string& portType)
         {
-            string hostName;
-            string port;
-
-            if (!context_.Configuration.StackConfiguration().contains("services"))
-            {
-                cout << "Stack configuration contains no 'services' element, not creating output streamer\n";
-                return {hostName, port};
-            }
-            cout << "Found 'services' section of stack configuration\n";
-
-            const json& servicesJson = context_.Configuration.StackConfiguration()["services"];
-            if (!servicesJson.contains(serviceName))
+            auto runtime = configuration_.Runtime();
+            const auto* service = runtime->FindService(serviceName);
+            if (service == nullptr)
             {
                 cout << "Stack configuration 'services' element contains no '" << serviceName << "' subelement, not creating output streamer\n";
-                return {hostName, port};
+                return StreamEndpoint { };
             }
             cout << "Found '" << serviceName << "' subsection of 'services' section of stack configuration\n";
 
-            const json& serviceJson = servicesJson[serviceName.c_str()];
-            if (serviceJson.contains("host"))
-            {
-                hostName = serviceJson["host"];
-            }
-
-            if (serviceJson.contains(portType))
-            {
-                port = serviceJson[portType.c_str()];
-            }
-
-            return {hostName, port};
+            return service->Endpoint(portType);
         }
 
         //
@@ -239,53 +315,19 @@ namespace embeddedpenguins::core::neuron::model
             string connectionString;
             string service;
 
-            if (!context_.Configuration.Control().contains("Execution"))
+            auto runtime = configuration_.Runtime();
+            if (runtime->OutputStreamers.empty())
             {
-                cout << "Configuration contains no 'Execution' element, not creating output streamer\n";
+                cout << "Configuration 'Execution' element contains no 'OutputStreamers', not creating output streamer\n";
                 return {connectionString, service};
             }
 
-            const json& executionJson = context_.Configuration.Control()["Execution"];
-            if (!executionJson.contains("OutputStreamers"))
+            for (auto& outputStreamer : runtime->OutputStreamers)
             {
-                cout << "Configuration 'Execution' element contains no 'OutputStreamers' subelement, not creating output streamer\n";
-                return {connectionString, service};
-            }
-
-            const json& outputStreamersJson = executionJson["OutputStreamers"];
-            if (outputStreamersJson.is_array())
-            {
-                for (auto& [key, outputStreamerJson] : outputStreamersJson.items())
+                if (outputStreamer.Location.find("SpikeOutputSocket") != string::npos)
                 {
-                    if (outputStreamerJson.is_object())
-                    {
-                        string outputStreamerLocation { "" };
-                        if (outputStreamerJson.contains("Location"))
-                        {
-                            const json& locationJson = outputStreamerJson["Location"];
-                            if (locationJson.is_string())
-                            {
-                                outputStreamerLocation = locationJson.get<string>();
-                            }
-                        }
-
-                        if (outputStreamerLocation.find("SpikeOutputSocket") != string::npos)
-                        {
-                            if (outputStreamerJson.contains("ConnectionString"))
-                            {
-                                const json& connectionStringJson = outputStreamerJson["ConnectionString"];
-                                if (connectionStringJson.is_string())
-                                    connectionString = connectionStringJson.get<string>();
-                            }
-
-                            if (outputStreamerJson.contains("Service"))
-                            {
-                                const json& serviceJson = outputStreamerJson["Service"];
-                                if (serviceJson.is_string())
-                                    service = serviceJson.get<string>();
-                            }
-                        }
-                    }
+                    if (!outputStreamer.ConnectionString.empty()) connectionString = outputStreamer.ConnectionString;
+                    if (!outputStreamer.Service.empty()) service = outputStreamer.Service;
                 }
             }
 
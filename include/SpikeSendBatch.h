@@ -0,0 +1,252 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <mutex>
+#include <cstring>
+#include <cerrno>
+#include <thread>
+
+#include <sys/socket.h>
+
+#include "IoUring.h"
+#include "ModelContext.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::vector;
+    using std::mutex;
+    using std::lock_guard;
+
+    constexpr unsigned int SpikeSendBatchEntries { 64 };
+
+    //
+    // Batch the spike socket sends of a whole tick into one system call.
+    // While a batch is active, SpikeOutputChannel queues its sections
+    // here instead of sending them; packets for the same socket are
+    // concatenated, so a socket sees one send per tick however many
+    // packets it had.  The engine submits the batch once per tick, after
+    // every output has been flushed:
+    //
+    //  unique_ptr<SpikeSendBatch> sendBatch;
+    //  if (IoUring::Configured(*configuration.Control()))
+    //      sendBatch = make_unique<SpikeSendBatch>(context);
+    //  ...
+    //  // Once per tick, after output fan-out:
+    //  if (sendBatch) sendBatch->Submit();
+    //
+    // The batch is made active through the model context, which every spike
+    // output is given, so outputs loaded from plugins find the engine's batch.
+    // Submit() waits for the sends to complete, so a socket's packets stay
+    // in order from tick to tick.  If io_uring cannot be set up, the batch is
+    // never made active, and the sockets send directly as before.
+    //
+    class SpikeSendBatch
+    {
+        struct PendingSend
+        {
+            int Fd { -1 };
+            vector<char> Bytes { };
+        };
+
+        ModelContext& context_;
+        mutex mutex_ { };
+        IoUring ring_ { };
+        vector<PendingSend> pending_ { };
+        vector<unsigned int> inFlight_ { };
+        unsigned long long int submits_ { 0 };
+        unsigned long long int sends_ { 0 };
+
+    public:
+        bool Valid() const { return ring_.Valid(); }
+        unsigned long long int Submits() const { return submits_; }
+        unsigned long long int Sends() const { return sends_; }
+
+    public:
+        SpikeSendBatch(ModelContext& context, unsigned int entries = SpikeSendBatchEntries) :
+            context_(context)
+        {
+            if (!ring_.Setup(entries))
+            {
+                cout << "SpikeSendBatch unable to set up io_uring: " << std::strerror(errno) << "; sending directly\n";
+                return;
+            }
+
+            SpikeSendBatch* expected { nullptr };
+            context_.SendBatch.compare_exchange_strong(expected, this);
+            cout << "SpikeSendBatch sending spikes in batches through io_uring\n";
+        }
+
+        SpikeSendBatch(const SpikeSendBatch& other) = delete;
+        SpikeSendBatch& operator=(const SpikeSendBatch& other) = delete;
+        SpikeSendBatch(SpikeSendBatch&& other) noexcept = delete;
+        SpikeSendBatch& operator=(SpikeSendBatch&& other) noexcept = delete;
+
+        ~SpikeSendBatch()
+        {
+            SpikeSendBatch* expected { this };
+            context_.SendBatch.compare_exchange_strong(expected, nullptr);
+
+            Submit();
+        }
+
+        //
+        // Copy a packet to be sent to the socket with the next Submit().
+        //
+        void Queue(int fd, const void* bytes, size_t byteCount)
+        {
+            lock_guard<mutex> lock(mutex_);
+
+            auto& pending = PendingFor(fd);
+            auto offset = pending.Bytes.size();
+            pending.Bytes.resize(offset + byteCount);
+            std::memcpy(pending.Bytes.data() + offset, bytes, byteCount);
+        }
+
+        //
+        // Send everything queued for the socket now, without waiting for the
+        // next Submit().  Call before closing a socket that may have packets queued.
+        //
+        void SendNow(int fd)
+        {
+            lock_guard<mutex> lock(mutex_);
+
+            for (auto& pending : pending_)
+            {
+                if (pending.Fd != fd) continue;
+
+                SendDirect(pending.Fd, pending.Bytes.data(), pending.Bytes.size());
+                pending.Bytes.clear();
+            }
+        }
+
+        //
+        // Submit one send per socket with anything queued, in a single
+        // system call, and wait for all of them to complete.
+        //
+        void Submit()
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (!ring_.Valid()) return;
+
+            for (unsigned int index = 0; index < pending_.size(); index++)
+            {
+                auto& pending = pending_[index];
+                if (pending.Bytes.empty()) continue;
+
+                auto* sqe = ring_.NextSqe();
+                if (!sqe)
+                {
+                    // More sockets than entries; finish these and carry on.
+                    SubmitAndComplete();
+                    sqe = ring_.NextSqe();
+                }
+
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = pending.Fd;
+                sqe->addr = reinterpret_cast<unsigned long long>(pending.Bytes.data());
+                sqe->len = static_cast<unsigned int>(pending.Bytes.size());
+                sqe->msg_flags = MSG_NOSIGNAL;
+                sqe->user_data = index;
+                inFlight_.push_back(index);
+            }
+
+            SubmitAndComplete();
+        }
+
+    private:
+        PendingSend& PendingFor(int fd)
+        {
+            for (auto& pending : pending_)
+                if (pending.Fd == fd)
+                    return pending;
+
+            for (auto& pending : pending_)
+            {
+                if (pending.Bytes.empty())
+                {
+                    pending.Fd = fd;
+                    return pending;
+                }
+            }
+
+            pending_.push_back(PendingSend { .Fd = fd });
+            return pending_.back();
+        }
+
+        //
+        // Submit the prepared sends and wait for every one to complete, since
+        // the kernel reads their buffers until then.  If submitting fails, the
+        // sends the kernel never took are taken back and sent directly; those it
+        // did take are still waited for, however long that takes.
+        //
+        void SubmitAndComplete()
+        {
+            auto inFlight = static_cast<unsigned int>(inFlight_.size());
+            if (inFlight == 0) return;
+
+            unsigned int completed { 0 };
+            bool reported { false };
+            while (completed < inFlight)
+            {
+                auto result = ring_.Submit(inFlight - completed);
+                submits_++;
+
+                completed += ring_.ReapCompletions([this](const io_uring_cqe& cqe) {
+                    auto& pending = pending_[cqe.user_data];
+                    if (cqe.res < 0)
+                        cout << "SpikeSendBatch send to fd " << pending.Fd << " failed: " << std::strerror(-cqe.res) << "\n";
+                    else if (static_cast<size_t>(cqe.res) < pending.Bytes.size())
+                        SendDirect(pending.Fd, pending.Bytes.data() + cqe.res, pending.Bytes.size() - cqe.res);
+
+                    sends_++;
+                    pending.Bytes.clear();
+                });
+
+                if (result >= 0) continue;
+
+                if (!reported)
+                {
+                    cout << "SpikeSendBatch unable to submit: " << std::strerror(-result) << "; sending directly\n";
+                    reported = true;
+                }
+
+                // Entries are taken in order, so those not taken are the last ones prepared.
+                auto discarded = ring_.DiscardPending();
+                for (auto position = inFlight - discarded; position < inFlight; position++)
+                {
+                    auto& pending = pending_[inFlight_[position]];
+                    SendDirect(pending.Fd, pending.Bytes.data(), pending.Bytes.size());
+                    pending.Bytes.clear();
+                }
+                inFlight -= discarded;
+
+                if (completed < inFlight)
+                    std::this_thread::yield();
+            }
+
+            inFlight_.clear();
+        }
+
+        //
+        // The rare remainder of a short send, or everything if the ring failed.
+        //
+        static void SendDirect(int fd, const char* bytes, size_t byteCount)
+        {
+            while (byteCount > 0)
+            {
+                auto sent = ::send(fd, bytes, byteCount, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR) continue;
+                    cout << "SpikeSendBatch send to fd " << fd << " failed: " << std::strerror(errno) << "\n";
+                    return;
+                }
+
+                bytes += sent;
+                byteCount -= sent;
+            }
+        }
+    };
+}
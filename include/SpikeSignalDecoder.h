@@ -0,0 +1,96 @@
+#pragma once
+
+#include <iostream>
+#include <limits>
+#include <atomic>
+
+#include "Log.h"
+#include "ConfigurationRepository.h"
+#include "SpikeSignalProtocol.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::numeric_limits;
+    using std::atomic;
+
+    //
+    // Translate received spike signal packets into local spikes: ticks relative
+    // to the sender become local ticks, and neuron indexes relative to the
+    // target layer become local model indexes.  Shared by every transport
+    // that carries spike signal packets, so they agree on the translation.
+    //
+    // Each spike is handed straight to the sink, as sink(tick, neuronIndex),
+    // so decoding allocates nothing.  Spikes are translated to storage
+    // indexes a packet at a time by the expansion map; any beyond the
+    // local model are dropped.
+    //
+    // Every packet is routed by its own population and layer, so one
+    // connection may carry spikes for any number of interconnects.  The
+    // last route is remembered, since consecutive packets usually share it.
+    //
+    class SpikeSignalDecoder
+    {
+        const atomic<unsigned long long int>& iterations_;
+        LogLevel& loggingLevel_;
+        const ConfigurationRepository& configuration_;
+
+        bool routed_ { false };
+        PopulationIndexFieldType population_ { 0 };
+        LayerOffsetFieldType layerOffset_ { 0 };
+        unsigned long int localOffset_ { 0 };
+        unsigned long long int unrouted_ { 0 };
+        unsigned long long int outOfRange_ { 0 };
+
+    public:
+        unsigned long long int Unrouted() const { return unrouted_; }
+        unsigned long long int OutOfRange() const { return outOfRange_; }
+
+    public:
+        SpikeSignalDecoder(const atomic<unsigned long long int>& iterations, LogLevel& loggingLevel, const ConfigurationRepository& configuration) :
+            iterations_(iterations),
+            loggingLevel_(loggingLevel),
+            configuration_(configuration)
+        {
+        }
+
+        template<class SINK>
+        void Decode(const SpikeSignalPacket& packet, SINK& sink)
+        {
+            if (!Route(packet.PopulationIndex, packet.LayerOffset))
+            {
+                if (unrouted_++ == 0 || loggingLevel_ != LogLevel::None)
+                    cout << "Dropping spikes for population index " << packet.PopulationIndex << " and layer offset " << packet.LayerOffset << ", which is not deployed here\n";
+                return;
+            }
+
+            int tickNow = static_cast<int>(iterations_);
+            auto spikeCount = packet.GetSpikeCount();
+            outOfRange_ += configuration_.ExpansionMap().TranslateToStorage(localOffset_, packet.GetSpikeSignals(), spikeCount,
+                [&sink, tickNow](const SpikeSignal& signalSpike, unsigned long int storageIndex) { sink(signalSpike.Tick + tickNow, storageIndex); });
+
+            if (loggingLevel_ != LogLevel::None)
+                cout << "Injecting input signal with " << spikeCount << " spikes at tick " << tickNow << "\n";
+        }
+
+    private:
+        bool Route(PopulationIndexFieldType population, LayerOffsetFieldType layerOffset)
+        {
+            if (routed_ && population == population_ && layerOffset == layerOffset_)
+                return true;
+
+            auto localOffset = configuration_.ExpansionMap().InputOffset(population, layerOffset);
+            if (localOffset == numeric_limits<unsigned long>::max())
+                return false;
+
+            if (loggingLevel_ != LogLevel::None)
+                cout << "Accepting spikes for population index " << population << " and layer offset " << layerOffset << " at local offset " << localOffset << "\n";
+
+            routed_ = true;
+            population_ = population;
+            layerOffset_ = layerOffset;
+            localOffset_ = localOffset;
+            return true;
+        }
+    };
+}
@@ -41,6 +41,10 @@ namespace embeddedpenguins::core::neuron::model
         // Immediately following this struct in memory should be an array
         // SpikeSignal Signals[capacity_];
         SpikeSignal* GetSpikeSignals() { return reinterpret_cast<SpikeSignal*>(this + 1); }
+        const SpikeSignal* GetSpikeSignals() const { return reinterpret_cast<const SpikeSignal*>(this + 1); }
+
+        // The number of spike signals, as given by the packet size in the envelope.
+        SpikeSignalLengthFieldType GetSpikeCount() const { return (PacketSize - (sizeof(SpikeHeader) - sizeof(SpikeEnvelope))) / sizeof(SpikeSignal); }
     };
 
     class SpikeSignalProtocol
@@ -119,7 +123,7 @@ namespace embeddedpenguins::core::neuron::model
         }
 
         // The full buffer size, including the envelope and header, needed for a given number of neurons.
-        static SpikeSignalLengthFieldType GetBufferSize(SpikeSignalLengthFieldType spikeCount)
+        static constexpr SpikeSignalLengthFieldType GetBufferSize(SpikeSignalLengthFieldType spikeCount)
         {
             return sizeof(SpikeSignalPacket) + spikeCount * SpikeSignalSize;
         }
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::unique_ptr;
+
+    constexpr std::string_view UnixEndpointScheme { "unix:" };
+    constexpr char AbstractEndpointPrefix { '@' };
+
+    enum class EndpointFamily
+    {
+        Inet,
+        Unix,
+        Abstract
+    };
+
+    //
+    // Where a stream socket connects or listens.  A connection string is one of:
+    //
+    //  host:port           a TCP socket (IPv4).
+    //  unix:/path/to/sock  a Unix domain socket at a filesystem path.
+    //  @name               a Unix domain socket in the Linux abstract namespace,
+    //                      which needs no file and vanishes with its listener.
+    //  unix:@name          the same.
+    //
+    // Local visualizers and sidecars use the last three to skip the TCP stack.
+    //
+    struct StreamEndpoint
+    {
+        EndpointFamily Family { EndpointFamily::Inet };
+        string Host {};
+        string Port {};
+        string Path {};
+
+        bool IsInet() const { return Family == EndpointFamily::Inet; }
+
+        //
+        // True if the string is a Unix domain or abstract endpoint rather than host:port.
+        //
+        static bool IsLocalSocket(const string& connectionString)
+        {
+            return (!connectionString.empty() && connectionString[0] == AbstractEndpointPrefix) ||
+                connectionString.compare(0, UnixEndpointScheme.size(), UnixEndpointScheme) == 0;
+        }
+
+        //
+        // Parse a connection string, using the defaults for a missing host or port.
+        //
+        static StreamEndpoint Parse(const string& connectionString, const string& defaultHost, const string& defaultPort)
+        {
+            StreamEndpoint endpoint { .Host = defaultHost, .Port = defaultPort };
+
+            if (IsLocalSocket(connectionString))
+            {
+                auto path = connectionString[0] == AbstractEndpointPrefix ? connectionString : connectionString.substr(UnixEndpointScheme.size());
+                if (!path.empty() && path[0] == AbstractEndpointPrefix)
+                {
+                    endpoint.Family = EndpointFamily::Abstract;
+                    endpoint.Path = path.substr(1);
+                }
+                else
+                {
+                    endpoint.Family = EndpointFamily::Unix;
+                    endpoint.Path = path;
+                }
+
+                return endpoint;
+            }
+
+            auto colonPos = connectionString.find(":");
+            if (colonPos != string::npos)
+            {
+                auto tempHost = connectionString.substr(0, colonPos);
+                if (!tempHost.empty()) endpoint.Host = tempHost;
+                auto tempPort = connectionString.substr(colonPos + 1);
+                if (!tempPort.empty()) endpoint.Port = tempPort;
+            }
+
+            return endpoint;
+        }
+
+        //
+        // The endpoint of a service from the stack configuration.  Either the
+        // port or the host may instead be a Unix domain or abstract endpoint;
+        // a port of that form wins, so one service may mix local and TCP ports.
+        //
+        static StreamEndpoint FromHostPort(const string& host, const string& port)
+        {
+            if (IsLocalSocket(port))
+                return Parse(port, host, string());
+
+            if (IsLocalSocket(host))
+                return Parse(host, string(), port);
+
+            return StreamEndpoint { .Host = host, .Port = port };
+        }
+
+        string ToString() const
+        {
+            switch (Family)
+            {
+                case EndpointFamily::Unix:
+                    return string(UnixEndpointScheme) + Path;
+                case EndpointFamily::Abstract:
+                    return string(1, AbstractEndpointPrefix) + Path;
+                default:
+                    return Host + ":" + Port;
+            }
+        }
+
+        //
+        // Fill in the address of a Unix domain or abstract endpoint.
+        // An abstract name starts with a null byte, and is not null-terminated.
+        //
+        bool UnixAddress(sockaddr_un& address, socklen_t& length) const
+        {
+            address = sockaddr_un { };
+            address.sun_family = AF_UNIX;
+
+            auto offset = Family == EndpointFamily::Abstract ? 1 : 0;
+            auto terminator = Family == EndpointFamily::Abstract ? 0 : 1;
+            if (Path.empty() || offset + Path.size() + terminator > sizeof(address.sun_path))
+                return false;
+
+            std::memcpy(address.sun_path + offset, Path.data(), Path.size());
+            length = offsetof(sockaddr_un, sun_path) + offset + Path.size() + terminator;
+            return true;
+        }
+    };
+
+    //
+    // A connected stream socket of any endpoint family, owning its descriptor.
+    //
+    class StreamConnection
+    {
+        int fd_ { -1 };
+        string peer_ {};
+
+    public:
+        int Fd() const { return fd_; }
+        const string& Peer() const { return peer_; }
+
+    public:
+        StreamConnection(int fd, const string& peer) :
+            fd_(fd),
+            peer_(peer)
+        {
+        }
+
+        StreamConnection(const StreamConnection& other) = delete;
+        StreamConnection& operator=(const StreamConnection& other) = delete;
+        StreamConnection(StreamConnection&& other) noexcept = delete;
+        StreamConnection& operator=(StreamConnection&& other) noexcept = delete;
+
+        ~StreamConnection()
+        {
+            if (fd_ >= 0) close(fd_);
+        }
+
+        //
+        // Connect to the endpoint, or return null (having logged why) if it cannot be reached.
+        //
+        static unique_ptr<StreamConnection> Connect(const StreamEndpoint& endpoint)
+        {
+            if (!endpoint.IsInet())
+            {
+                sockaddr_un address {};
+                socklen_t length {};
+                if (!endpoint.UnixAddress(address, length))
+                {
+                    cout << "StreamConnection invalid local socket name " << endpoint.ToString() << "\n";
+                    return unique_ptr<StreamConnection>();
+                }
+
+                auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), length) == 0)
+                    return std::make_unique<StreamConnection>(fd, endpoint.ToString());
+
+                cout << "StreamConnection unable to connect to " << endpoint.ToString() << ": " << std::strerror(errno) << "\n";
+                if (fd >= 0) close(fd);
+                return unique_ptr<StreamConnection>();
+            }
+
+            addrinfo hints {};
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* addresses { nullptr };
+            auto status = getaddrinfo(endpoint.Host.c_str(), endpoint.Port.c_str(), &hints, &addresses);
+            if (status != 0)
+            {
+                cout << "StreamConnection unable to resolve " << endpoint.ToString() << ": " << gai_strerror(status) << "\n";
+                return unique_ptr<StreamConnection>();
+            }
+
+            int fd { -1 };
+            for (auto* address = addresses; address != nullptr && fd < 0; address = address->ai_next)
+            {
+                fd = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+                if (fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) != 0)
+                {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(addresses);
+
+            if (fd < 0)
+            {
+                cout << "StreamConnection unable to connect to " << endpoint.ToString() << ": " << std::strerror(errno) << "\n";
+                return unique_ptr<StreamConnection>();
+            }
+
+            return std::make_unique<StreamConnection>(fd, endpoint.ToString());
+        }
+
+        //
+        // Write the whole buffer, blocking as needed.  Return false if the connection failed.
+        //
+        bool Send(const void* buffer, size_t length)
+        {
+            auto* next = static_cast<const char*>(buffer);
+            while (length > 0)
+            {
+                auto sent = ::send(fd_, next, length, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+
+                next += sent;
+                length -= sent;
+            }
+
+            return true;
+        }
+
+        //
+        // Read up to length bytes, blocking until at least one arrives.
+        // Return the count, zero if the peer closed the connection, or negative on failure.
+        //
+        ssize_t Receive(void* buffer, size_t length)
+        {
+            ssize_t received;
+            while ((received = ::recv(fd_, buffer, length, 0)) < 0 && errno == EINTR) ;
+
+            return received;
+        }
+
+        void Shutdown()
+        {
+            if (fd_ >= 0) ::shutdown(fd_, SHUT_RDWR);
+        }
+
+        //
+        // Make sends and receives return EAGAIN rather than block.  Send() above
+        // expects a blocking socket, so callers doing this manage their own sends.
+        //
+        bool SetNonBlocking()
+        {
+            auto flags = ::fcntl(fd_, F_GETFL);
+            return flags >= 0 && ::fcntl(fd_, F_SETFL, flags | O_NONBLOCK) == 0;
+        }
+    };
+
+    //
+    // A listening stream socket of any endpoint family.
+    // A Unix domain socket file left by a previous run is replaced, but only
+    // if it is a socket nobody is listening on; any other file, or a live
+    // socket, is left alone and the listen fails.  The file is removed again
+    // when the listener closes, if it is still the one this listener bound.
+    //
+    class StreamListener
+    {
+        StreamEndpoint endpoint_ {};
+        int fd_ { -1 };
+        dev_t boundDevice_ {};
+        ino_t boundInode_ {};
+
+    public:
+        int Fd() const { return fd_; }
+        bool Listening() const { return fd_ >= 0; }
+        const StreamEndpoint& Endpoint() const { return endpoint_; }
+
+    public:
+        StreamListener() = default;
+
+        StreamListener(const StreamListener& other) = delete;
+        StreamListener& operator=(const StreamListener& other) = delete;
+        StreamListener(StreamListener&& other) noexcept = delete;
+        StreamListener& operator=(StreamListener&& other) noexcept = delete;
+
+        ~StreamListener()
+        {
+            Close();
+        }
+
+        bool Listen(const StreamEndpoint& endpoint)
+        {
+            Close();
+            endpoint_ = endpoint;
+
+            fd_ = endpoint_.IsInet() ? BindInet() : BindUnix();
+            if (fd_ < 0) return false;
+
+            if (::listen(fd_, SOMAXCONN) != 0)
+            {
+                cout << "StreamListener unable to listen at " << endpoint_.ToString() << ": " << std::strerror(errno) << "\n";
+                Close();
+                return false;
+            }
+
+            return true;
+        }
+
+        //
+        // Accept one pending connection, or return null if there is none.
+        //
+        unique_ptr<StreamConnection> Accept()
+        {
+            sockaddr_storage address {};
+            socklen_t length { sizeof(address) };
+
+            int fd;
+            while ((fd = ::accept4(fd_, reinterpret_cast<sockaddr*>(&address), &length, SOCK_CLOEXEC)) < 0 && errno == EINTR) ;
+            if (fd < 0)
+            {
+                cout << "StreamListener unable to accept at " << endpoint_.ToString() << ": " << std::strerror(errno) << "\n";
+                return unique_ptr<StreamConnection>();
+            }
+
+            return std::make_unique<StreamConnection>(fd, DescribePeer(address, length));
+        }
+
+        void Close()
+        {
+            if (fd_ < 0) return;
+
+            close(fd_);
+            fd_ = -1;
+
+            struct stat status {};
+            if (endpoint_.Family == EndpointFamily::Unix && lstat(endpoint_.Path.c_str(), &status) == 0 &&
+                S_ISSOCK(status.st_mode) && status.st_dev == boundDevice_ && status.st_ino == boundInode_)
+                unlink(endpoint_.Path.c_str());
+        }
+
+    private:
+        int BindInet()
+        {
+            addrinfo hints {};
+            hints.ai_flags = AI_PASSIVE;
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* addresses { nullptr };
+            auto status = getaddrinfo(endpoint_.Host.c_str(), endpoint_.Port.c_str(), &hints, &addresses);
+            if (status != 0)
+            {
+                cout << "StreamListener unable to resolve " << endpoint_.ToString() << ": " << gai_strerror(status) << "\n";
+                return -1;
+            }
+
+            int fd { -1 };
+            for (auto* address = addresses; address != nullptr && fd < 0; address = address->ai_next)
+            {
+                fd = ::socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+                if (fd < 0) continue;
+
+                // So we can restart immediately, without waiting out the old socket.
+                int reuseaddr = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(reuseaddr));
+
+                if (::bind(fd, address->ai_addr, address->ai_addrlen) != 0)
+                {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+            freeaddrinfo(addresses);
+
+            if (fd < 0)
+                cout << "StreamListener unable to bind " << endpoint_.ToString() << ": " << std::strerror(errno) << "\n";
+
+            return fd;
+        }
+
+        int BindUnix()
+        {
+            sockaddr_un address {};
+            socklen_t length {};
+            if (!endpoint_.UnixAddress(address, length))
+            {
+                cout << "StreamListener invalid local socket name " << endpoint_.ToString() << "\n";
+                return -1;
+            }
+
+            auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                cout << "StreamListener unable to create socket for " << endpoint_.ToString() << ": " << std::strerror(errno) << "\n";
+                return -1;
+            }
+
+            if (endpoint_.Family == EndpointFamily::Unix && !RemoveStaleSocket(address, length))
+            {
+                close(fd);
+                return -1;
+            }
+
+            if (::bind(fd, reinterpret_cast<sockaddr*>(&address), length) != 0)
+            {
+                cout << "StreamListener unable to bind " << endpoint_.ToString() << ": " << std::strerror(errno) << "\n";
+                close(fd);
+                return -1;
+            }
+
+            struct stat status {};
+            if (endpoint_.Family == EndpointFamily::Unix && lstat(endpoint_.Path.c_str(), &status) == 0)
+            {
+                boundDevice_ = status.st_dev;
+                boundInode_ = status.st_ino;
+            }
+
+            return fd;
+        }
+
+        //
+        // Remove the socket file at our path if it was left by a listener that
+        // has gone:  it is a socket, and connecting to it is refused.
+        // Return false, having logged why, if something else is there.
+        //
+        bool RemoveStaleSocket(const sockaddr_un& address, socklen_t length)
+        {
+            struct stat status {};
+            if (lstat(endpoint_.Path.c_str(), &status) != 0)
+                return errno == ENOENT;
+
+            if (!S_ISSOCK(status.st_mode))
+            {
+                cout << "StreamListener will not replace " << endpoint_.Path << ", which is not a socket\n";
+                return false;
+            }
+
+            auto probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (probe < 0) return false;
+
+            auto connected = ::connect(probe, reinterpret_cast<const sockaddr*>(&address), length) == 0;
+            auto refused = !connected && errno == ECONNREFUSED;
+            close(probe);
+
+            if (!refused)
+            {
+                cout << "StreamListener will not replace " << endpoint_.Path << ", which is in use\n";
+                return false;
+            }
+
+            unlink(endpoint_.Path.c_str());
+            return true;
+        }
+
+        string DescribePeer(const sockaddr_storage& address, socklen_t length) const
+        {
+            if (address.ss_family != AF_INET && address.ss_family != AF_INET6)
+                return endpoint_.ToString();
+
+            char host[NI_MAXHOST] {};
+            char port[NI_MAXSERV] {};
+            if (getnameinfo(reinterpret_cast<const sockaddr*>(&address), length, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+                return endpoint_.ToString();
+
+            return string(host) + ":" + port;
+        }
+    };
+}
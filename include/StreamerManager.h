@@ -0,0 +1,439 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#include "nlohmann/json.hpp"
+
+#include "ModelContext.h"
+#include "ConfigurationRepository.h"
+#include "OutputInterest.h"
+#include "SpikeOutputProxy.h"
+#include "SensorInputProxy.h"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::vector;
+    using std::multiset;
+    using std::unique_ptr;
+    using std::make_unique;
+    using std::atomic;
+    using std::mutex;
+    using std::lock_guard;
+    using std::unique_lock;
+    using std::try_to_lock;
+    using std::condition_variable;
+    using std::chrono::milliseconds;
+    using std::chrono::steady_clock;
+
+    constexpr milliseconds StreamerHandoffTimeout { 2'000 };
+    constexpr milliseconds StreamerHandoffStep { 50 };
+
+    using nlohmann::json;
+
+    //
+    // The difference between the 'Execution' sections of two control files.
+    // A streamer is identified by its whole entry, so an entry that changed
+    // in any way is removed and its replacement added.  Changes to any other
+    // part of the 'Execution' section take effect only on restart.
+    //
+    struct StreamerChanges
+    {
+        vector<json> AddedOutputs {};
+        vector<json> RemovedOutputs {};
+        vector<json> AddedInputs {};
+        vector<json> RemovedInputs {};
+        vector<string> RestartRequired {};
+
+        bool Empty() const
+        {
+            return AddedOutputs.empty() && RemovedOutputs.empty() && AddedInputs.empty() && RemovedInputs.empty();
+        }
+
+        json Render() const
+        {
+            return json {
+                {"addedoutputs", AddedOutputs},
+                {"removedoutputs", RemovedOutputs},
+                {"addedinputs", AddedInputs},
+                {"removedinputs", RemovedInputs},
+                {"restartrequired", RestartRequired}
+            };
+        }
+
+        static StreamerChanges Diff(const json& previousControl, const json& control)
+        {
+            StreamerChanges changes {};
+
+            const json previousExecution = ExecutionSection(previousControl);
+            const json execution = ExecutionSection(control);
+
+            DiffStreamers(previousExecution, execution, "OutputStreamers", changes.AddedOutputs, changes.RemovedOutputs);
+            DiffStreamers(previousExecution, execution, "InputStreamers", changes.AddedInputs, changes.RemovedInputs);
+
+            for (auto& [key, value] : execution.items())
+                if (key != "OutputStreamers" && key != "InputStreamers" && (!previousExecution.contains(key) || previousExecution[key] != value))
+                    changes.RestartRequired.push_back(key);
+
+            for (auto& [key, value] : previousExecution.items())
+                if (key != "OutputStreamers" && key != "InputStreamers" && !execution.contains(key))
+                    changes.RestartRequired.push_back(key);
+
+            return changes;
+        }
+
+    private:
+        static json ExecutionSection(const json& control)
+        {
+            if (control.is_object() && control.contains("Execution") && control["Execution"].is_object())
+                return control["Execution"];
+
+            return json::object();
+        }
+
+        static multiset<string> StreamerKeys(const json& execution, const char* section)
+        {
+            multiset<string> keys {};
+            if (execution.contains(section) && execution[section].is_array())
+                for (auto& streamerJson : execution[section])
+                    if (streamerJson.is_object())
+                        keys.insert(streamerJson.dump());
+
+            return keys;
+        }
+
+        static void DiffStreamers(const json& previousExecution, const json& execution, const char* section, vector<json>& added, vector<json>& removed)
+        {
+            auto previousKeys = StreamerKeys(previousExecution, section);
+            auto keys = StreamerKeys(execution, section);
+
+            vector<string> difference {};
+            std::set_difference(keys.begin(), keys.end(), previousKeys.begin(), previousKeys.end(), std::back_inserter(difference));
+            for (auto& key : difference)
+                added.push_back(json::parse(key));
+
+            difference.clear();
+            std::set_difference(previousKeys.begin(), previousKeys.end(), keys.begin(), keys.end(), std::back_inserter(difference));
+            for (auto& key : difference)
+                removed.push_back(json::parse(key));
+        }
+    };
+
+    //
+    // Own the spike output and sensor input proxies configured in the
+    // 'Execution' section of the control file, so they can be attached and
+    // detached while the engine runs.
+    //
+    // A reload (from a command, or a watcher on the control file) reloads the
+    // control file and stages the difference.  The engine calls ApplyStaged()
+    // between ticks, which only moves proxies between lists, and never waits
+    // for a reload in progress.  The reloading thread does the slow work:
+    // * First the removals are handed to the engine, and once it has detached
+    //   them (or at once, if the engine is not running) they are disconnected
+    //   and unloaded, freeing their ports and connections.
+    // * Only then are new proxies loaded and connected, so a streamer that
+    //   changed in place can take over the port of the one it replaces.
+    // If the engine does not detach the removals within StreamerHandoffTimeout,
+    // the additions are connected anyway, and the removals are released on
+    // the next reload, or on destruction.
+    //
+    // Only the engine thread may use Outputs(), Inputs() and Interest().
+    //
+    class StreamerManager
+    {
+        struct OutputStreamer
+        {
+            string Key {};
+            unique_ptr<SpikeOutputProxy> Proxy {};
+        };
+
+        struct InputStreamer
+        {
+            string Key {};
+            unique_ptr<SensorInputProxy> Proxy {};
+        };
+
+        ModelContext& context_;
+
+        // Engine thread.
+        vector<OutputStreamer> outputs_ {};
+        vector<InputStreamer> inputs_ {};
+        vector<ISpikeOutput*> outputViews_ {};
+        vector<ISensorInput*> inputViews_ {};
+
+        // Reloading thread, handed over under mutex_.
+        mutex reloadMutex_ {};
+        mutex mutex_ {};
+        condition_variable applied_ {};
+        atomic<bool> staged_ { false };
+        vector<OutputStreamer> stagedOutputs_ {};
+        vector<InputStreamer> stagedInputs_ {};
+        vector<string> stagedOutputRemovals_ {};
+        vector<string> stagedInputRemovals_ {};
+        vector<OutputStreamer> retiredOutputs_ {};
+        vector<InputStreamer> retiredInputs_ {};
+
+    public:
+        const vector<ISpikeOutput*>& Outputs() const { return outputViews_; }
+        const vector<ISensorInput*>& Inputs() const { return inputViews_; }
+
+    public:
+        StreamerManager(ModelContext& context) :
+            context_(context)
+        {
+            Active() = this;
+        }
+
+        StreamerManager(const StreamerManager& other) = delete;
+        StreamerManager& operator=(const StreamerManager& other) = delete;
+        StreamerManager(StreamerManager&& other) noexcept = delete;
+        StreamerManager& operator=(StreamerManager&& other) noexcept = delete;
+
+        ~StreamerManager()
+        {
+            auto* self = this;
+            Active().compare_exchange_strong(self, nullptr);
+
+            ApplyStaged(true);
+            for (auto& output : outputs_) retiredOutputs_.push_back(std::move(output));
+            for (auto& input : inputs_) retiredInputs_.push_back(std::move(input));
+            ReleaseRetired();
+        }
+
+        //
+        // Attach every streamer in the current control file.  Call once, before the engine runs.
+        //
+        void AttachConfigured()
+        {
+            lock_guard<mutex> lock(reloadMutex_);
+            Stage(StreamerChanges::Diff(json::object(), *context_.Configuration.Control()));
+            ApplyStaged(true);
+        }
+
+        //
+        // Reload the control file and stage the streamers that changed.
+        // Return false if the control file could not be reloaded;
+        // otherwise the changes are rendered into 'changes'.
+        //
+        bool Reload(json& changes)
+        {
+            lock_guard<mutex> lock(reloadMutex_);
+
+            json previousControl;
+            if (!context_.Configuration.ReloadControl(previousControl))
+                return false;
+
+            auto streamerChanges = StreamerChanges::Diff(previousControl, *context_.Configuration.Control());
+            for (auto& setting : streamerChanges.RestartRequired)
+                cout << "Control 'Execution' element '" << setting << "' changed, takes effect on restart\n";
+
+            Stage(streamerChanges);
+            changes = streamerChanges.Render();
+            return true;
+        }
+
+        //
+        // Engine thread, between ticks.  Attach and detach the staged streamers.
+        // Costs one atomic load when nothing is staged.  Unless forced, a reload
+        // still staging is left for a later tick rather than waited for.
+        // Return true if the streamers changed.
+        //
+        bool ApplyStaged(bool force = false)
+        {
+            if (!staged_.load()) return false;
+
+            unique_lock<mutex> lock(mutex_, try_to_lock);
+            if (!lock.owns_lock())
+            {
+                if (!force) return false;
+                lock.lock();
+            }
+
+            for (auto& key : stagedOutputRemovals_)
+                Detach(outputs_, retiredOutputs_, key);
+            for (auto& key : stagedInputRemovals_)
+                Detach(inputs_, retiredInputs_, key);
+
+            for (auto& output : stagedOutputs_) outputs_.push_back(std::move(output));
+            for (auto& input : stagedInputs_) inputs_.push_back(std::move(input));
+
+            stagedOutputRemovals_.clear();
+            stagedInputRemovals_.clear();
+            stagedOutputs_.clear();
+            stagedInputs_.clear();
+            staged_ = false;
+
+            outputViews_.clear();
+            for (auto& output : outputs_) outputViews_.push_back(output.Proxy.get());
+            inputViews_.clear();
+            for (auto& input : inputs_) inputViews_.push_back(input.Proxy.get());
+
+            lock.unlock();
+            applied_.notify_all();
+
+            cout << "Streamers now " << outputs_.size() << " outputs, " << inputs_.size() << " inputs\n";
+            return true;
+        }
+
+        //
+        // What the attached outputs are interested in, given the recording flags.
+        //
+        OutputInterest Interest() const
+        {
+            return CombineOutputInterest(outputViews_, context_);
+        }
+
+        //
+        // The manager of the running model, if any.
+        //
+        static atomic<StreamerManager*>& Active()
+        {
+            static atomic<StreamerManager*> active { nullptr };
+            return active;
+        }
+
+    private:
+        //
+        // Release the removed streamers, then load and connect the added
+        // streamers and queue them for the engine.
+        //
+        void Stage(const StreamerChanges& changes)
+        {
+            StageRemovals(changes);
+            ReleaseRetired();
+
+            vector<OutputStreamer> outputs {};
+            for (auto& outputJson : changes.AddedOutputs)
+            {
+                auto location = StringProperty(outputJson, "Location");
+                if (location.empty()) continue;
+
+                auto proxy = make_unique<SpikeOutputProxy>(location);
+                proxy->CreateProxy(context_);
+                if (!proxy->Valid() || !proxy->Connect())
+                {
+                    cout << "Unable to attach spike output " << location << ": " << proxy->ErrorReason() << "\n";
+                    continue;
+                }
+
+                cout << "Staged spike output " << location << "\n";
+                outputs.push_back({ outputJson.dump(), std::move(proxy) });
+            }
+
+            vector<InputStreamer> inputs {};
+            for (auto& inputJson : changes.AddedInputs)
+            {
+                auto location = StringProperty(inputJson, "Location");
+                if (location.empty()) continue;
+
+                auto proxy = make_unique<SensorInputProxy>(location);
+                proxy->CreateProxy(context_.Configuration, context_.Measurements.Iterations, context_.LoggingLevel);
+                if (!proxy->Valid() || !proxy->Connect(StringProperty(inputJson, "ConnectionString")))
+                {
+                    cout << "Unable to attach sensor input " << location << ": " << proxy->ErrorReason() << "\n";
+                    continue;
+                }
+
+                cout << "Staged sensor input " << location << "\n";
+                inputs.push_back({ inputJson.dump(), std::move(proxy) });
+            }
+
+            lock_guard<mutex> lock(mutex_);
+            for (auto& output : outputs) stagedOutputs_.push_back(std::move(output));
+            for (auto& input : inputs) stagedInputs_.push_back(std::move(input));
+
+            staged_ = !stagedOutputs_.empty() || !stagedInputs_.empty() || !stagedOutputRemovals_.empty() || !stagedInputRemovals_.empty();
+        }
+
+        //
+        // Queue the removals for the engine, and wait for it to detach them.
+        // While the engine is not running, nothing else applies staged changes,
+        // so they are applied here instead.
+        //
+        void StageRemovals(const StreamerChanges& changes)
+        {
+            unique_lock<mutex> lock(mutex_);
+
+            // A streamer removed before the engine attached it is simply dropped.
+            for (auto& outputJson : changes.RemovedOutputs)
+                if (!Detach(stagedOutputs_, retiredOutputs_, outputJson.dump()))
+                    stagedOutputRemovals_.push_back(outputJson.dump());
+            for (auto& inputJson : changes.RemovedInputs)
+                if (!Detach(stagedInputs_, retiredInputs_, inputJson.dump()))
+                    stagedInputRemovals_.push_back(inputJson.dump());
+
+            auto removalsPending = [this]() { return !stagedOutputRemovals_.empty() || !stagedInputRemovals_.empty(); };
+            if (!removalsPending()) return;
+
+            staged_ = true;
+            auto deadline = steady_clock::now() + StreamerHandoffTimeout;
+            while (removalsPending())
+            {
+                if (!context_.Run)
+                {
+                    lock.unlock();
+                    ApplyStaged(true);
+                    lock.lock();
+                    continue;
+                }
+
+                // Wait in short steps, so an engine that stops meanwhile is noticed.
+                applied_.wait_until(lock, std::min(deadline, steady_clock::now() + StreamerHandoffStep));
+                if (steady_clock::now() >= deadline && removalsPending())
+                {
+                    cout << "Engine did not detach removed streamers within " << StreamerHandoffTimeout.count() << " ms; they are released on the next reload\n";
+                    return;
+                }
+            }
+        }
+
+        //
+        // Disconnect and unload streamers the engine has already detached.
+        //
+        void ReleaseRetired()
+        {
+            vector<OutputStreamer> retiredOutputs {};
+            vector<InputStreamer> retiredInputs {};
+            {
+                lock_guard<mutex> lock(mutex_);
+                retiredOutputs.swap(retiredOutputs_);
+                retiredInputs.swap(retiredInputs_);
+            }
+
+            for (auto& output : retiredOutputs)
+            {
+                output.Proxy->Flush();
+                output.Proxy->Disconnect();
+            }
+
+            for (auto& input : retiredInputs)
+                input.Proxy->Disconnect();
+        }
+
+        template<class STREAMER>
+        static bool Detach(vector<STREAMER>& streamers, vector<STREAMER>& retired, const string& key)
+        {
+            auto streamer = std::find_if(streamers.begin(), streamers.end(), [&key](const STREAMER& candidate) { return candidate.Key == key; });
+            if (streamer == streamers.end()) return false;
+
+            retired.push_back(std::move(*streamer));
+            streamers.erase(streamer);
+            return true;
+        }
+
+        static string StringProperty(const json& objectJson, const char* name)
+        {
+            return objectJson.contains(name) && objectJson[name].is_string() ? objectJson[name].get<string>() : string();
+        }
+    };
+}
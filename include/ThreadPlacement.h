@@ -0,0 +1,304 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <filesystem>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "nlohmann/json.hpp"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::cout;
+    using std::string;
+    using std::ifstream;
+    using std::istringstream;
+    using std::getline;
+    using std::vector;
+    using std::map;
+    using std::mutex;
+    using std::lock_guard;
+    using std::filesystem::exists;
+
+    using nlohmann::json;
+
+    // From linux/mempolicy.h, which is not always installed.
+    constexpr int MemoryPolicyPreferred { 1 };
+
+    //
+    // Where a thread should run: the set of CPUs it may run on, its
+    // real-time (SCHED_FIFO) priority, and the NUMA node its memory
+    // should come from.  Each field is optional; an unset field leaves
+    // the default scheduling behavior alone.
+    // Placements are read from the 'ThreadPlacement' element of the control
+    // file 'Execution' section, keyed by thread name, for example:
+    //
+    //  "ThreadPlacement": {
+    //      "Engine": { "Cpus": [2, 3], "Priority": 50, "NumaNode": 0 },
+    //      "SensorInput": { "Cpus": [4] }
+    //  }
+    //
+    // Every thread that applies a named placement with a registry is
+    // registered there, so that the actual placement of all threads can
+    // be rendered for status.
+    //
+    struct ThreadPlacement;
+
+    //
+    // The threads placed for one engine, with the placement each requested
+    // and the placement it actually got, captured once when applied.
+    // An engine owns one registry (see ConfigurationRepository::Threads())
+    // and hands it to everything that places threads, including plugins:
+    // a registry static in this header would be a separate copy in each
+    // dlopen'ed library, and threads placed there would never be seen.
+    //
+    class ThreadRegistry
+    {
+        struct Registration
+        {
+            vector<int> RequestedCpus {};
+            int RequestedPriority { 0 };
+            int RequestedNumaNode { -1 };
+            pid_t ThreadId {};
+            json Actual {};
+        };
+
+        mutable mutex mutex_ {};
+        map<string, Registration> threads_ {};
+
+    public:
+        ThreadRegistry() = default;
+
+        ThreadRegistry(const ThreadRegistry& other) = delete;
+        ThreadRegistry& operator=(const ThreadRegistry& other) = delete;
+        ThreadRegistry(ThreadRegistry&& other) noexcept = delete;
+        ThreadRegistry& operator=(ThreadRegistry&& other) noexcept = delete;
+
+        //
+        // Called by ThreadPlacement::Apply(), on the thread being placed.
+        //
+        void Register(const string& name, const vector<int>& cpus, int priority, int numaNode)
+        {
+            Registration registration { .RequestedCpus = cpus, .RequestedPriority = priority, .RequestedNumaNode = numaNode, .ThreadId = static_cast<pid_t>(syscall(SYS_gettid)) };
+
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+            {
+                vector<int> actualCpus;
+                for (auto cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                    if (CPU_ISSET(cpu, &cpuSet)) actualCpus.push_back(cpu);
+                registration.Actual["cpus"] = actualCpus;
+            }
+
+            auto policy = sched_getscheduler(0);
+            registration.Actual["policy"] = policy == SCHED_FIFO ? "fifo" : policy == SCHED_RR ? "rr" : "other";
+
+            sched_param parameters { };
+            if (sched_getparam(0, &parameters) == 0)
+                registration.Actual["priority"] = parameters.sched_priority;
+
+            lock_guard<mutex> lock(mutex_);
+            threads_[name] = std::move(registration);
+        }
+
+        //
+        // Render the requested and actual placement of every registered thread.
+        // No system calls; the actual placement was captured when applied.
+        //
+        json Render() const
+        {
+            json placements = json::object();
+
+            lock_guard<mutex> lock(mutex_);
+            for (auto& [name, registration] : threads_)
+            {
+                placements[name] = {
+                    {"requested", {{"cpus", registration.RequestedCpus}, {"priority", registration.RequestedPriority}, {"numanode", registration.RequestedNumaNode}}},
+                    {"actual", registration.Actual}
+                };
+            }
+
+            return placements;
+        }
+
+        //
+        // The name and kernel thread id of every registered thread.
+        //
+        vector<std::pair<string, pid_t>> RegisteredThreads() const
+        {
+            vector<std::pair<string, pid_t>> threads;
+
+            lock_guard<mutex> lock(mutex_);
+            for (auto& [name, registration] : threads_)
+                threads.push_back({ name, registration.ThreadId });
+
+            return threads;
+        }
+    };
+
+    struct ThreadPlacement
+    {
+        string Name {};
+        vector<int> Cpus {};
+        int Priority { 0 };
+        int NumaNode { -1 };
+        ThreadRegistry* Registry { nullptr };
+
+        bool Empty() const { return Cpus.empty() && Priority == 0 && NumaNode < 0; }
+
+        //
+        // Look up the placement for the named thread.  If no placement
+        // exists for the exact name, fall back to the placement for the
+        // base name, so that "SensorInput2" may use "SensorInput".
+        //
+        static ThreadPlacement FromConfiguration(const json& control, const string& name, const string& baseName = "")
+        {
+            ThreadPlacement placement { .Name = name };
+
+            if (!control.contains("Execution")) return placement;
+            const json& executionJson = control["Execution"];
+
+            if (!executionJson.contains("ThreadPlacement")) return placement;
+            const json& placementsJson = executionJson["ThreadPlacement"];
+            if (!placementsJson.is_object()) return placement;
+
+            const json* placementJson { nullptr };
+            if (placementsJson.contains(name))
+                placementJson = &placementsJson[name];
+            else if (!baseName.empty() && placementsJson.contains(baseName))
+                placementJson = &placementsJson[baseName];
+
+            if (placementJson == nullptr || !placementJson->is_object()) return placement;
+
+            if (placementJson->contains("Cpus"))
+            {
+                const json& cpusJson = (*placementJson)["Cpus"];
+                if (cpusJson.is_array())
+                    placement.Cpus = cpusJson.get<vector<int>>();
+            }
+
+            if (placementJson->contains("Priority"))
+            {
+                const json& priorityJson = (*placementJson)["Priority"];
+                if (priorityJson.is_number_integer())
+                    placement.Priority = priorityJson.get<int>();
+            }
+
+            if (placementJson->contains("NumaNode"))
+            {
+                const json& numaNodeJson = (*placementJson)["NumaNode"];
+                if (numaNodeJson.is_number_integer())
+                    placement.NumaNode = numaNodeJson.get<int>();
+            }
+
+            return placement;
+        }
+
+        //
+        // Apply this placement to the calling thread.  Failures (typically lack of
+        // permission for real-time priority) are reported, but are not fatal.
+        // Once applied, memory first touched by this thread comes from its NUMA node.
+        // If the placement has a registry, the thread is registered there by name.
+        //
+        bool Apply() const
+        {
+            auto success { true };
+            auto threadHandle = pthread_self();
+
+            if (!Name.empty())
+                pthread_setname_np(threadHandle, Name.substr(0, 15).c_str());
+
+            auto numaNode = NumaNode;
+            if (numaNode >= 0 && !exists("/sys/devices/system/node/node" + std::to_string(numaNode)))
+            {
+                cout << "Thread " << Name << " requested NUMA node " << numaNode << ", which does not exist\n";
+                numaNode = -1;
+                success = false;
+            }
+
+            auto cpus = Cpus;
+            if (cpus.empty() && numaNode >= 0)
+                cpus = ReadNodeCpus(numaNode);
+
+            if (!cpus.empty())
+            {
+                cpu_set_t cpuSet;
+                CPU_ZERO(&cpuSet);
+                for (auto cpu : cpus)
+                    if (cpu >= 0 && cpu < CPU_SETSIZE)
+                        CPU_SET(cpu, &cpuSet);
+
+                if (pthread_setaffinity_np(threadHandle, sizeof(cpuSet), &cpuSet) != 0)
+                {
+                    cout << "Thread " << Name << " unable to set CPU affinity\n";
+                    success = false;
+                }
+            }
+
+            if (Priority > 0)
+            {
+                sched_param parameters { };
+                parameters.sched_priority = Priority;
+                if (pthread_setschedparam(threadHandle, SCHED_FIFO, &parameters) != 0)
+                {
+                    cout << "Thread " << Name << " unable to set SCHED_FIFO priority " << Priority << " (requires CAP_SYS_NICE)\n";
+                    success = false;
+                }
+            }
+
+            if (numaNode >= 0)
+            {
+                // A mask of as many words as the node needs; the kernel reads maxnode - 1 bits.
+                constexpr int bitsPerWord { sizeof(unsigned long) * 8 };
+                vector<unsigned long> nodeMask(numaNode / bitsPerWord + 1, 0UL);
+                nodeMask[numaNode / bitsPerWord] = 1UL << (numaNode % bitsPerWord);
+                if (syscall(SYS_set_mempolicy, MemoryPolicyPreferred, nodeMask.data(), nodeMask.size() * bitsPerWord + 1) != 0)
+                {
+                    cout << "Thread " << Name << " unable to prefer memory from NUMA node " << numaNode << "\n";
+                    success = false;
+                }
+            }
+
+            if (Registry && !Name.empty())
+                Registry->Register(Name, Cpus, Priority, NumaNode);
+
+            return success;
+        }
+
+    private:
+        //
+        // Read the CPUs belonging to a NUMA node from sysfs, in the form "0-3,8-11".
+        //
+        static vector<int> ReadNodeCpus(int numaNode)
+        {
+            vector<int> cpus;
+
+            ifstream cpuListFile("/sys/devices/system/node/node" + std::to_string(numaNode) + "/cpulist");
+            string cpuList;
+            if (!getline(cpuListFile, cpuList)) return cpus;
+
+            istringstream ranges(cpuList);
+            string range;
+            while (getline(ranges, range, ','))
+            {
+                auto dashPos = range.find('-');
+                auto first = std::stoi(range.substr(0, dashPos));
+                auto last = dashPos == string::npos ? first : std::stoi(range.substr(dashPos + 1));
+                for (auto cpu = first; cpu <= last; cpu++)
+                    cpus.push_back(cpu);
+            }
+
+            return cpus;
+        }
+    };
+}
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "nlohmann/json.hpp"
+
+namespace embeddedpenguins::core::neuron::model
+{
+    using std::string;
+    using std::atomic;
+    using std::mutex;
+    using std::lock_guard;
+    using std::memory_order_relaxed;
+    using std::uint64_t;
+    using std::chrono::steady_clock;
+    using std::chrono::nanoseconds;
+    using std::chrono::milliseconds;
+
+    using nlohmann::json;
+
+    //
+    // The phases of one engine tick that are timed separately.
+    // 'Tick' is the whole tick, start to finish.
+    //
+    enum class TickStage
+    {
+        Input,
+        Compute,
+        Output,
+        Record,
+        Tick,
+        Count
+    };
+
+    //
+    // Time spent in each stage of every tick, kept in fixed-bucket
+    // log-linear (HDR style) histograms: each power of two is split into
+    // 16 linear sub-buckets, so any recorded value is within about 6%
+    // of its bucket, from one clock tick up to many seconds.
+    //
+    // Recording is a timestamp read and one relaxed atomic store per
+    // stage, with no locks or allocation.  Each stage must only be
+    // recorded from one thread at a time (the single writer), but any
+    // thread may render the histograms while recording continues.
+    //
+    // Timing uses the CPU time stamp counter where available, calibrated
+    // against the steady clock once per process; otherwise the steady clock.
+    // Calibration sleeps briefly, so it happens when the profiler is
+    // constructed (at engine setup), never while rendering a status query.
+    //
+    // Reset does not touch the histograms, which would race with the
+    // writer; it captures a baseline that is subtracted when rendering.
+    //
+    // A copy is a snapshot of the source histograms at the time of copying.
+    //
+    class TickProfiler
+    {
+        static constexpr unsigned int SubBucketBits { 4 };
+        static constexpr unsigned int SubBuckets { 1 << SubBucketBits };
+        static constexpr unsigned int Magnitudes { 48 };
+        static constexpr unsigned int BucketCount { (Magnitudes - SubBucketBits + 1) * SubBuckets };
+        static constexpr unsigned int StageCount { static_cast<unsigned int>(TickStage::Count) };
+
+        struct Histogram
+        {
+            atomic<uint64_t> Counts[BucketCount] { };
+            atomic<uint64_t> Total { 0 };
+        };
+
+        struct Baseline
+        {
+            uint64_t Counts[BucketCount] { };
+            uint64_t Total { 0 };
+        };
+
+        Histogram histograms_[StageCount] { };
+        Baseline baselines_[StageCount] { };
+        mutable mutex baselineMutex_ { };
+
+    public:
+        //
+        // Time the enclosing scope as one sample of a stage.
+        // A null profiler makes the timer a no-op, so optional profiling
+        // costs only a branch.
+        //
+        class ScopedTimer
+        {
+            TickProfiler* profiler_;
+            TickStage stage_;
+            uint64_t start_ { 0 };
+
+        public:
+            ScopedTimer(TickProfiler* profiler, TickStage stage) :
+                profiler_(profiler),
+                stage_(stage)
+            {
+                if (profiler_) start_ = Now();
+            }
+
+            ScopedTimer(const ScopedTimer& other) = delete;
+            ScopedTimer& operator=(const ScopedTimer& other) = delete;
+            ScopedTimer(ScopedTimer&& other) noexcept = delete;
+            ScopedTimer& operator=(ScopedTimer&& other) noexcept = delete;
+
+            ~ScopedTimer()
+            {
+                if (profiler_) profiler_->Record(stage_, Now() - start_);
+            }
+        };
+
+    public:
+        TickProfiler()
+        {
+            TicksPerMicrosecond();
+        }
+
+        TickProfiler(const TickProfiler& other)
+        {
+            TicksPerMicrosecond();
+            CopyFrom(other);
+        }
+
+        TickProfiler& operator=(const TickProfiler& other)
+        {
+            if (this != &other) CopyFrom(other);
+            return *this;
+        }
+
+        //
+        // Read the clock used for timing, in clock ticks.
+        //
+        static uint64_t Now()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#else
+            return steady_clock::now().time_since_epoch().count();
+#endif
+        }
+
+        //
+        // Writer only.  Add one sample, in clock ticks as returned by Now().
+        //
+        void Record(TickStage stage, uint64_t elapsed)
+        {
+            auto& histogram = histograms_[static_cast<unsigned int>(stage)];
+            auto& count = histogram.Counts[BucketIndex(elapsed)];
+            count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            histogram.Total.store(histogram.Total.load(memory_order_relaxed) + elapsed, memory_order_relaxed);
+        }
+
+        //
+        // Any thread.  Discard everything recorded so far from future renders.
+        //
+        void Reset()
+        {
+            lock_guard<mutex> lock(baselineMutex_);
+            for (unsigned int stage = 0; stage < StageCount; stage++)
+            {
+                for (unsigned int bucket = 0; bucket < BucketCount; bucket++)
+                    baselines_[stage].Counts[bucket] = histograms_[stage].Counts[bucket].load(memory_order_relaxed);
+                baselines_[stage].Total = histograms_[stage].Total.load(memory_order_relaxed);
+            }
+        }
+
+        //
+        // Any thread.  Render the sample count, mean and percentiles of each stage,
+        // in microseconds.  Percentiles and the maximum are reported as the
+        // upper edge of their bucket.
+        //
+        json Render() const
+        {
+            static const char* stageNames[StageCount] { "input", "compute", "output", "record", "tick" };
+            auto ticksPerMicrosecond = TicksPerMicrosecond();
+
+            json profile = json::object();
+
+            lock_guard<mutex> lock(baselineMutex_);
+            for (unsigned int stage = 0; stage < StageCount; stage++)
+            {
+                uint64_t counts[BucketCount];
+                uint64_t samples { 0 };
+                for (unsigned int bucket = 0; bucket < BucketCount; bucket++)
+                {
+                    counts[bucket] = histograms_[stage].Counts[bucket].load(memory_order_relaxed) - baselines_[stage].Counts[bucket];
+                    samples += counts[bucket];
+                }
+
+                if (samples == 0)
+                {
+                    profile[stageNames[stage]] = { {"count", 0} };
+                    continue;
+                }
+
+                auto total = histograms_[stage].Total.load(memory_order_relaxed) - baselines_[stage].Total;
+                auto toMicroseconds = [ticksPerMicrosecond](uint64_t ticks) { return ticks / ticksPerMicrosecond; };
+
+                profile[stageNames[stage]] = {
+                    {"count", samples},
+                    {"mean", toMicroseconds(total) / samples},
+                    {"p50", toMicroseconds(Percentile(counts, samples, 0.5))},
+                    {"p99", toMicroseconds(Percentile(counts, samples, 0.99))},
+                    {"p999", toMicroseconds(Percentile(counts, samples, 0.999))},
+                    {"max", toMicroseconds(Percentile(counts, samples, 1.0))}
+                };
+            }
+
+            return profile;
+        }
+
+        //
+        // The profiler of the running model, if any, so that it may be
+        // reported and reset without a path through the model runner.
+        //
+        static atomic<TickProfiler*>& Active()
+        {
+            static atomic<TickProfiler*> active { nullptr };
+            return active;
+        }
+
+        //
+        // Clock ticks per microsecond, measured once per process.
+        //
+        static double TicksPerMicrosecond()
+        {
+            static double ticksPerMicrosecond = Calibrate();
+            return ticksPerMicrosecond;
+        }
+
+    private:
+        static unsigned int BucketIndex(uint64_t value)
+        {
+            if (value < SubBuckets) return value;
+
+            unsigned int magnitude = 63 - __builtin_clzll(value);
+            if (magnitude >= Magnitudes) return BucketCount - 1;
+
+            auto subBucket = (value >> (magnitude - SubBucketBits)) - SubBuckets;
+            return (magnitude - SubBucketBits + 1) * SubBuckets + subBucket;
+        }
+
+        static uint64_t BucketUpperEdge(unsigned int bucket)
+        {
+            if (bucket < SubBuckets) return bucket;
+
+            auto magnitude = bucket / SubBuckets - 1 + SubBucketBits;
+            auto subBucket = bucket % SubBuckets;
+            return ((SubBuckets + subBucket + 1) << (magnitude - SubBucketBits)) - 1;
+        }
+
+        static uint64_t Percentile(const uint64_t (&counts)[BucketCount], uint64_t samples, double fraction)
+        {
+            auto target = static_cast<uint64_t>(fraction * samples + 0.5);
+            if (target < 1) target = 1;
+
+            uint64_t seen { 0 };
+            unsigned int highest { 0 };
+            for (unsigned int bucket = 0; bucket < BucketCount; bucket++)
+            {
+                if (counts[bucket] == 0) continue;
+
+                highest = bucket;
+                seen += counts[bucket];
+                if (seen >= target) return BucketUpperEdge(bucket);
+            }
+
+            return BucketUpperEdge(highest);
+        }
+
+        static double Calibrate()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            auto startTime = steady_clock::now();
+            auto startTicks = Now();
+            std::this_thread::sleep_for(milliseconds(10));
+            auto elapsedTicks = Now() - startTicks;
+            auto elapsedTime = std::chrono::duration_cast<nanoseconds>(steady_clock::now() - startTime).count();
+
+            return elapsedTime > 0 ? elapsedTicks * 1000.0 / elapsedTime : 1000.0;
+#else
+            return 1000.0;
+#endif
+        }
+
+        void CopyFrom(const TickProfiler& other)
+        {
+            lock_guard<mutex> lock(other.baselineMutex_);
+            for (unsigned int stage = 0; stage < StageCount; stage++)
+            {
+                for (unsigned int bucket = 0; bucket < BucketCount; bucket++)
+                    histograms_[stage].Counts[bucket].store(other.histograms_[stage].Counts[bucket].load(memory_order_relaxed), memory_order_relaxed);
+                histograms_[stage].Total.store(other.histograms_[stage].Total.load(memory_order_relaxed), memory_order_relaxed);
+                baselines_[stage] = other.baselines_[stage];
+            }
+        }
+    };
+}
@@ -8,6 +8,8 @@
 #include <chrono>
 #include <condition_variable>
 
+#include "ThreadPlacement.h"
+
 namespace embeddedpenguins::core::neuron::model
 {
     using std::cout;
@@ -27,6 +29,14 @@ namespace embeddedpenguins::core::neuron::model
     // The instance of IMPLEMENTATIONTYPE that executes the task must be provided
     // in the constructor.
     //
+    // An optional placement pins the thread to CPUs, a real-time priority and
+    // a NUMA node.  If IMPLEMENTATIONTYPE also implements
+    //
+    //void ThreadStart();
+    //
+    // it is called on the new thread after placement, before the constructor
+    // returns, so buffers it allocates there are first touched on the right node.
+    //
     // NOTE the IMPLEMENTATIONTYPE class is expected to implement the required methods,
     //      but no interface exists to enforce the implementation.  Run time
     //      will be faster using compile-time polymorphism with templates rather
@@ -55,17 +65,21 @@ namespace embeddedpenguins::core::neuron::model
         bool cycleStart_{false};
         bool cycleDone_{false};
         bool firstScan_ { true };
+        bool started_ { false };
 
         WorkCode code_{WorkCode::Run};
         thread workerThread_;
 
         IMPLEMENTATIONTYPE& implementation_;
+        const ThreadPlacement placement_;
 
     public:
-        WorkerThread(IMPLEMENTATIONTYPE& implementation) :
-            implementation_(implementation)
+        WorkerThread(IMPLEMENTATIONTYPE& implementation, const ThreadPlacement& placement = ThreadPlacement { }) :
+            implementation_(implementation),
+            placement_(placement)
         {
             workerThread_ = thread(std::ref(*this));
+            WaitForStart();
         }
 
         ~WorkerThread()
@@ -83,6 +97,8 @@ namespace embeddedpenguins::core::neuron::model
         //
         void operator() ()
         {
+            Start();
+
             try
             {
                 while (code_ != WorkCode::Quit)
@@ -160,6 +176,25 @@ namespace embeddedpenguins::core::neuron::model
 
     private:
         /////////////////////////// Called from worker thread /////////////////////////
+        //
+        // Place this thread, let the implementation allocate its
+        // buffers here, then release the constructor.
+        //
+        void Start()
+        {
+            if (!placement_.Empty() || !placement_.Name.empty())
+                placement_.Apply();
+
+            if constexpr (requires { implementation_.ThreadStart(); })
+                implementation_.ThreadStart();
+
+            {
+                lock_guard<mutex> lock(mutexReturn_);
+                started_ = true;
+            }
+            cvReturn_.notify_one();
+        }
+
         bool WaitForSignal()
         {
             unique_lock<mutex> lock(mutex_);
@@ -194,6 +229,12 @@ namespace embeddedpenguins::core::neuron::model
         }
 
         /////////////////////////// Called from client thread /////////////////////////
+        void WaitForStart()
+        {
+            unique_lock<mutex> lock(mutexReturn_);
+            cvReturn_.wait(lock, [this]{ return started_; });
+        }
+
         void Scan(WorkCode code)
         {
             // If running continuous, will not finish previous scan, don't wait.